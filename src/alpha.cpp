@@ -0,0 +1,70 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "alpha.hpp"
+
+#include <algorithm>
+
+std::unique_ptr<Color[]> flatten_alpha(const Configuration& config, const uint8_t* rgba, size_t count, std::vector<uint8_t>& visible)
+{
+    auto pixels { std::make_unique<Color[]>(count) };
+    auto* out = reinterpret_cast<uint8_t*>(pixels.get());
+
+    const Color background = config.alpha_weighted ? Color { 0, 0, 0 } : config.background;
+    const uint32_t back[3] { background.red, background.green, background.blue };
+
+    visible.resize(count);
+    bool hidden = false;
+
+    for(size_t i = 0; i < count; i++) {
+        const uint32_t alpha = rgba[4 * i + 3];
+        for(size_t channel = 0; channel < 3; channel++) {
+            out[3 * i + channel] = static_cast<uint8_t>((rgba[4 * i + channel] * alpha + back[channel] * (255 - alpha) + 127) / 255);
+        }
+
+        visible[i] = alpha != 0;
+        hidden |= alpha == 0;
+    }
+
+    if(!hidden) {
+        visible.clear();
+    }
+
+    return pixels;
+}
+
+std::vector<uint8_t> blank_cells(const uint8_t* visible, size_t img_width, const CellSpans& columns, const CellSpans& rows)
+{
+    std::vector<uint8_t> blank(columns.size() * rows.size(), 1);
+
+    for(size_t row = 0; row < rows.size(); row++) {
+        uint8_t* cells = blank.data() + row * columns.size();
+
+        for(size_t y = rows.begin[row]; y < std::max(rows.end[row], rows.begin[row] + 1); y++) {
+            const uint8_t* line = visible + y * img_width;
+
+            for(size_t col = 0; col < columns.size(); col++) {
+                const uint8_t* begin = line + columns.begin[col];
+                const uint8_t* end = line + std::max(columns.end[col], columns.begin[col] + 1);
+                if(cells[col] != 0 && std::any_of(begin, end, [](uint8_t pixel) { return pixel != 0; })) {
+                    cells[col] = 0;
+                }
+            }
+        }
+    }
+
+    return blank;
+}
@@ -0,0 +1,35 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "conversion.hpp"
+
+// RGBA pixels composited over `config.background` into the RGB image the modes that do not
+// read RGBA themselves (see plane_supported) take. --background none has no meaning per
+// pixel, so those modes composite over black instead. `visible` gets one byte per pixel, set
+// where alpha is not 0, for doAsciiConversion to blank cells with none; it is left empty when
+// every pixel is visible.
+std::unique_ptr<Color[]> flatten_alpha(const Configuration& config, const uint8_t* rgba, size_t count, std::vector<uint8_t>& visible);
+
+// Per cell of the columns x rows grid, row major: 1 where none of its pixels is `visible`.
+// Cells narrower than a pixel look at the pixel they start in.
+std::vector<uint8_t> blank_cells(const uint8_t* visible, size_t img_width, const CellSpans& columns, const CellSpans& rows);
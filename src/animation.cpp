@@ -0,0 +1,71 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "animation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "alpha.hpp"
+#include "trace.hpp"
+
+std::vector<std::string> convert_frames(const Configuration& config, const uint8_t* frames, size_t frame_count, size_t width, size_t height)
+{
+    std::vector<std::string> out(frame_count);
+
+    const size_t length = width * height;
+    const bool plane = plane_supported(config, width, height);
+    std::atomic<size_t> next { 0 };
+
+    const size_t cores = config.max_threads != 0 ? config.max_threads : std::thread::hardware_concurrency();
+    const size_t workers = std::clamp<size_t>(cores, 1, std::max<size_t>(1, frame_count));
+
+    // Frames are the parallel unit; a conversion only gets the cores left over when there are
+    // fewer frames than cores, instead of starting a pool of its own per frame.
+    Configuration frame_config = config;
+    frame_config.max_threads = std::max<size_t>(1, cores / workers);
+
+    const auto work = [&](size_t worker) {
+        trace_thread_name("frame worker");
+        TraceScope scope("convert frames", "worker", static_cast<int64_t>(worker));
+
+        for(size_t frame = next++; frame < frame_count; frame = next++) {
+            TraceScope frame_scope("convert frame", "frame", static_cast<int64_t>(frame));
+            const uint8_t* rgba = frames + 4 * length * frame;
+
+            if(plane) {
+                doRgbaConversion(frame_config, out[frame], rgba, width, height);
+            } else {
+                std::vector<uint8_t> visible;
+                const auto pixels = flatten_alpha(frame_config, rgba, length, visible);
+                doAsciiConversion(frame_config, out[frame], pixels, width, height, nullptr, visible.empty() ? nullptr : visible.data());
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t worker = 1; worker < workers; worker++) {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return out;
+}
@@ -0,0 +1,32 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Renders `frame_count` RGBA frames of width x height pixels, stored back to back as
+// stbi_load_gif_from_memory returns them, into one string each. Frames are independent, so
+// a pool of one thread per core (or config.max_threads) takes them off a shared counter;
+// each thread converts its frame as a still image would be (RGBA cells straight from the
+// decoded frames, or flattened for the other modes), single threaded unless cores outnumber
+// frames.
+std::vector<std::string> convert_frames(const Configuration& config, const uint8_t* frames, size_t frame_count, size_t width, size_t height);
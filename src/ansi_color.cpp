@@ -0,0 +1,268 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "ansi_color.hpp"
+
+#include <array>
+#include <charconv>
+#include <cstdlib>
+
+static constexpr uint8_t CUBE_LEVELS[6] = { 0, 95, 135, 175, 215, 255 };
+
+static constexpr size_t CUBE_START = 16;
+static constexpr size_t GREY_START = 232;
+static constexpr size_t PALETTE_SIZE = 256;
+static constexpr size_t GREY_LEVELS = PALETTE_SIZE - GREY_START;
+
+static constexpr Color SYSTEM_COLORS[CUBE_START] = {
+    { 0, 0, 0 }, { 128, 0, 0 }, { 0, 128, 0 }, { 128, 128, 0 },
+    { 0, 0, 128 }, { 128, 0, 128 }, { 0, 128, 128 }, { 192, 192, 192 },
+    { 128, 128, 128 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+    { 0, 0, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 },
+};
+
+constexpr Color xterm_color_at(size_t index)
+{
+    if(index < CUBE_START) {
+        return SYSTEM_COLORS[index];
+    }
+
+    if(index < GREY_START) {
+        const size_t cube = index - CUBE_START;
+        return { CUBE_LEVELS[cube / 36], CUBE_LEVELS[(cube / 6) % 6], CUBE_LEVELS[cube % 6] };
+    }
+
+    const auto grey = static_cast<uint8_t>(8 + 10 * (index - GREY_START));
+    return { grey, grey, grey };
+}
+
+Color xterm_color(uint8_t index)
+{
+    return xterm_color_at(index);
+}
+
+static constexpr int distance_squared(const Color& a, const Color& b)
+{
+    const int red = a.red - b.red;
+    const int green = a.green - b.green;
+    const int blue = a.blue - b.blue;
+
+    return red * red + green * green + blue * blue;
+}
+
+int xterm_distance_squared(const Color& color, uint8_t index)
+{
+    return distance_squared(color, xterm_color_at(index));
+}
+
+uint8_t nearest_xterm_index(const Color& color)
+{
+    size_t best = CUBE_START;
+    int best_distance = distance_squared(color, xterm_color(static_cast<uint8_t>(best)));
+
+    for(size_t index = CUBE_START + 1; index < PALETTE_SIZE; index++) {
+        const int distance = distance_squared(color, xterm_color(static_cast<uint8_t>(index)));
+
+        if(distance < best_distance) {
+            best = index;
+            best_distance = distance;
+        }
+    }
+
+    return static_cast<uint8_t>(best);
+}
+
+// The cube is a separable grid, so its nearest entry is the nearest level on each channel, and
+// the distance to a grey is a parabola in the grey value with its minimum at the channel mean.
+// Comparing those two candidates gives the same answer as searching all 240 entries.
+static constexpr size_t nearest_cube_level(int value)
+{
+    size_t best = 0;
+    for(size_t level = 1; level < 6; level++) {
+        if(std::abs(value - CUBE_LEVELS[level]) < std::abs(value - CUBE_LEVELS[best])) {
+            best = level;
+        }
+    }
+
+    return best;
+}
+
+static constexpr uint8_t nearest_xterm_index_separable(const Color& color)
+{
+    const size_t cube = CUBE_START + 36 * nearest_cube_level(color.red) + 6 * nearest_cube_level(color.green) + nearest_cube_level(color.blue);
+
+    const int mean = (color.red + color.green + color.blue) / 3;
+    size_t grey = GREY_START;
+    for(size_t level = 1; level < GREY_LEVELS; level++) {
+        if(std::abs(mean - (8 + 10 * static_cast<int>(level))) < std::abs(mean - (8 + 10 * static_cast<int>(grey - GREY_START)))) {
+            grey = GREY_START + level;
+        }
+    }
+
+    // Check the neighbouring grey too, the integer mean can round onto the wrong side.
+    size_t best = cube;
+    for(size_t candidate : { grey, grey > GREY_START ? grey - 1 : grey, grey + 1 < PALETTE_SIZE ? grey + 1 : grey }) {
+        if(distance_squared(color, xterm_color_at(candidate)) < distance_squared(color, xterm_color_at(best))) {
+            best = candidate;
+        }
+    }
+
+    return static_cast<uint8_t>(best);
+}
+
+static constexpr size_t LUT_BITS = 5;
+static constexpr size_t LUT_SIDE = 1 << LUT_BITS;
+static constexpr size_t LUT_SHIFT = 8 - LUT_BITS;
+
+// Each entry holds the answer for the centre of its 8x8x8 block of colours.
+static constexpr std::array<uint8_t, LUT_SIDE * LUT_SIDE * LUT_SIDE> build_xterm_lut()
+{
+    std::array<uint8_t, LUT_SIDE * LUT_SIDE * LUT_SIDE> lut { };
+    constexpr size_t half_step = 1 << (LUT_SHIFT - 1);
+
+    for(size_t r = 0; r < LUT_SIDE; r++) {
+        for(size_t g = 0; g < LUT_SIDE; g++) {
+            for(size_t b = 0; b < LUT_SIDE; b++) {
+                const Color centre {
+                    static_cast<uint8_t>((r << LUT_SHIFT) + half_step),
+                    static_cast<uint8_t>((g << LUT_SHIFT) + half_step),
+                    static_cast<uint8_t>((b << LUT_SHIFT) + half_step),
+                };
+
+                lut[(r << (2 * LUT_BITS)) | (g << LUT_BITS) | b] = nearest_xterm_index_separable(centre);
+            }
+        }
+    }
+
+    return lut;
+}
+
+static constexpr auto XTERM_LUT = build_xterm_lut();
+
+uint8_t xterm_index(const Color& color)
+{
+    return XTERM_LUT[(static_cast<size_t>(color.red >> LUT_SHIFT) << (2 * LUT_BITS)) | (static_cast<size_t>(color.green >> LUT_SHIFT) << LUT_BITS) | static_cast<size_t>(color.blue >> LUT_SHIFT)];
+}
+
+static void append_number(std::string& out, unsigned value)
+{
+    char digits[4];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+// `layer` is "38" for the foreground or "48" for the background.
+static void select_color(std::string& out, ColorMode mode, uint8_t tolerance, std::string_view layer, SgrState& state, const Color& color)
+{
+    const bool close = state.emitted
+        && std::abs(color.red - state.last.red) <= tolerance
+        && std::abs(color.green - state.last.green) <= tolerance
+        && std::abs(color.blue - state.last.blue) <= tolerance;
+
+    if(close) {
+        return;
+    }
+
+    if(mode == ColorMode::TRUECOLOR) {
+        out += "\x1b[";
+        out += layer;
+        out += ";2;";
+        append_number(out, color.red);
+        out += ';';
+        append_number(out, color.green);
+        out += ';';
+        append_number(out, color.blue);
+        out += 'm';
+    } else {
+        const uint8_t index = xterm_index(color);
+
+        if(!state.emitted || index != state.last_index) {
+            out += "\x1b[";
+            out += layer;
+            out += ";5;";
+            append_number(out, index);
+            out += 'm';
+            state.last_index = index;
+        }
+    }
+
+    state.last = color;
+    state.emitted = true;
+}
+
+ForegroundWriter::ForegroundWriter(ColorMode color_mode, uint8_t color_tolerance)
+    : mode(color_mode), tolerance(color_tolerance)
+{
+}
+
+void ForegroundWriter::write(std::string& out, const Color& color, char glyph)
+{
+    if(mode != ColorMode::NONE && glyph != ' ') {
+        select_color(out, mode, tolerance, "38", state, color);
+    }
+
+    out += glyph;
+}
+
+void ForegroundWriter::write(std::string& out, const Color& color, std::string_view glyph)
+{
+    if(mode != ColorMode::NONE && glyph != " ") {
+        select_color(out, mode, tolerance, "38", state, color);
+    }
+
+    out.append(glyph);
+}
+
+void ForegroundWriter::finish(std::string& out)
+{
+    if(state.emitted) {
+        out += "\x1b[0m";
+        state.emitted = false;
+    }
+}
+
+HalfBlockWriter::HalfBlockWriter(ColorMode color_mode, uint8_t color_tolerance)
+    : mode(color_mode == ColorMode::NONE ? ColorMode::TRUECOLOR : color_mode), tolerance(color_tolerance)
+{
+}
+
+void HalfBlockWriter::write(std::string& out, const Color& top, const Color& bottom)
+{
+    select_color(out, mode, tolerance, "38", foreground, top);
+    select_color(out, mode, tolerance, "48", background, bottom);
+    out += UPPER_HALF_BLOCK;
+}
+
+void HalfBlockWriter::write_blank(std::string& out)
+{
+    if(background.emitted) {
+        out += "\x1b[49m";
+        background.emitted = false;
+    }
+
+    out += ' ';
+}
+
+void HalfBlockWriter::end_row(std::string& out)
+{
+    if(foreground.emitted || background.emitted) {
+        out += "\x1b[0m";
+        foreground.emitted = false;
+        background.emitted = false;
+    }
+
+    out += '\n';
+}
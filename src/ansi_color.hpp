@@ -0,0 +1,92 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "conversion.hpp"
+
+// xterm-256 palette entry (index 0-255) as RGB.
+Color xterm_color(uint8_t index);
+
+// Nearest xterm-256 entry by squared RGB distance, searching the 6x6x6 cube and the grey ramp
+// (16-255). The 16 system colours are skipped since terminals theme them.
+uint8_t nearest_xterm_index(const Color& color);
+
+// Same mapping through a 32x32x32 table built at compile time; one load per colour. Colours
+// near a boundary between two entries can land on the slightly further one, see
+// `ascii --bench-palette` for how often and by how much.
+uint8_t xterm_index(const Color& color);
+
+int xterm_distance_squared(const Color& color, uint8_t index);
+
+// Last colour selected on one SGR layer (foreground or background).
+struct SgrState
+{
+    bool emitted = false;
+    Color last { };
+    uint8_t last_index = 0;
+};
+
+// Emits foreground SGR sequences, skipping any that would not change what is on screen:
+// cells whose colour is within `tolerance` (per channel) of the last emitted colour, and
+// cells that are blank.
+class ForegroundWriter
+{
+public:
+    ForegroundWriter(ColorMode color_mode, uint8_t color_tolerance);
+
+    void write(std::string& out, const Color& color, char glyph);
+    void write(std::string& out, const Color& color, std::string_view glyph);
+
+    // Resets attributes if anything was emitted.
+    void finish(std::string& out);
+
+private:
+    ColorMode mode;
+    uint8_t tolerance;
+    SgrState state;
+};
+
+static constexpr std::string_view UPPER_HALF_BLOCK { "\u2580" };
+
+// Draws two colours per cell with an upper half block: the foreground colours the top half
+// and the background the bottom. Each layer's escape is only emitted when its colour changes
+// (beyond `tolerance`), so a run of cells with the same pair costs three bytes each.
+// ColorMode::NONE is drawn as truecolor, the glyph alone carries no picture.
+class HalfBlockWriter
+{
+public:
+    HalfBlockWriter(ColorMode color_mode, uint8_t color_tolerance);
+
+    void write(std::string& out, const Color& top, const Color& bottom);
+
+    // A space on the terminal's own background, for cells with nothing to draw.
+    void write_blank(std::string& out);
+
+    // Resets attributes before the newline so the background does not bleed into the rest of
+    // the terminal line.
+    void end_row(std::string& out);
+
+private:
+    ColorMode mode;
+    uint8_t tolerance;
+    SgrState foreground;
+    SgrState background;
+};
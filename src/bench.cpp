@@ -0,0 +1,613 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "animation.hpp"
+#include "ansi_color.hpp"
+#include "conversion.hpp"
+#include "hdr.hpp"
+#include "luma.hpp"
+
+static constexpr size_t BENCH_RUNS = 11;
+
+// The plain conversion. Its own time is checked against the baseline's, and every other
+// workload's time is checked as a ratio to it in the same run, so a pass that slows down on its
+// own is told apart from the whole machine (or the plain path under everything) slowing down.
+static constexpr std::string_view REFERENCE_WORKLOAD = "luma-1080p-w160";
+
+// A workload fails once its time, or its time relative to the reference, grows past this
+// multiple of the baseline's. Times still move by a few tens of percent from run to run on a
+// shared machine, so only a coarse slowdown is caught, the kind that halves a kernel's
+// throughput.
+static constexpr double TIME_TOLERANCE = 1.5;
+
+// Smooth gradients, a disc and some hash noise so the whole density ramp gets exercised.
+static std::unique_ptr<Color[]> make_test_image(size_t width, size_t height)
+{
+    auto pixels { std::make_unique<Color[]>(width * height) };
+    const double radius = static_cast<double>(std::min(width, height)) / 3;
+
+    for(size_t y = 0; y < height; y++) {
+        for(size_t x = 0; x < width; x++) {
+            const double fx = static_cast<double>(x) / static_cast<double>(width);
+            const double fy = static_cast<double>(y) / static_cast<double>(height);
+            const double dx = static_cast<double>(x) - static_cast<double>(width) / 2;
+            const double dy = static_cast<double>(y) - static_cast<double>(height) / 2;
+
+            uint32_t noise = static_cast<uint32_t>(x * 374761393U + y * 668265263U);
+            noise = (noise ^ (noise >> 13)) * 1274126177U;
+            const double grain = static_cast<double>(noise >> 28) - 8;
+
+            const bool inside = std::sqrt(dx * dx + dy * dy) < radius;
+            const double red = inside ? 255 * (1 - fy) : 255 * fx;
+            const double green = inside ? 128 : 180 * fx;
+            const double blue = inside ? 255 * fx : 255 * (1 - fx);
+
+            const auto channel = [grain](double value) {
+                return static_cast<uint8_t>(std::clamp(value + grain, 0.0, 255.0));
+            };
+
+            pixels[x + y * width] = { channel(red), channel(green), channel(blue) };
+        }
+    }
+
+    return pixels;
+}
+
+// White over the top three quarters, mid grey below: error diffusion must not carry anything
+// out of the saturated area into the grey.
+static std::unique_ptr<Color[]> make_saturated_image(size_t width, size_t height)
+{
+    auto pixels { std::make_unique<Color[]>(width * height) };
+
+    for(size_t y = 0; y < height; y++) {
+        const Color color = y < height * 3 / 4 ? Color { 255, 255, 255 } : Color { 128, 128, 128 };
+        std::fill_n(pixels.get() + y * width, width, color);
+    }
+
+    return pixels;
+}
+
+// Layout the test image is handed to the converter in, as main would load it. Everything but
+// RGB is encoded from the test image before timing starts; tone mapping is timed with the
+// conversion, as it runs on every load.
+enum class BenchSource
+{
+    RGB,
+    GRAY,
+    RGBA,
+    DEEP,
+    HDR,
+    FRAMES,
+};
+
+static constexpr size_t BENCH_FRAMES = 8;
+
+struct BenchWorkload
+{
+    std::string_view name;
+    size_t width;
+    size_t height;
+    uint32_t cols;
+    void (*setup)(Configuration& config);
+    std::unique_ptr<Color[]> (*image)(size_t width, size_t height) = make_test_image;
+    BenchSource source = BenchSource::RGB;
+};
+
+// Alpha ramps up from fully transparent on the left, so there are blank, partly covered and
+// opaque cells.
+static uint8_t test_alpha(size_t x, size_t width)
+{
+    return static_cast<uint8_t>(std::clamp<size_t>(x * 320 / width, 64, 319) - 64);
+}
+
+static std::vector<uint8_t> encode_source(BenchSource source, const Color* pixels, size_t width, size_t height)
+{
+    const size_t count = width * height;
+    std::vector<uint8_t> bytes;
+
+    switch(source) {
+        case BenchSource::RGB: break;
+        case BenchSource::GRAY:
+            bytes.resize(count);
+            for(size_t i = 0; i < count; i++) {
+                bytes[i] = static_cast<uint8_t>(std::lround(luma(pixels[i]) * LUMA_MAX));
+            }
+            break;
+        case BenchSource::RGBA:
+            bytes.resize(4 * count);
+            for(size_t i = 0; i < count; i++) {
+                bytes[4 * i] = pixels[i].red;
+                bytes[4 * i + 1] = pixels[i].green;
+                bytes[4 * i + 2] = pixels[i].blue;
+                bytes[4 * i + 3] = test_alpha(i % width, width);
+            }
+            break;
+        case BenchSource::DEEP: {
+            bytes.resize(3 * count * sizeof(uint16_t));
+            auto* channels = reinterpret_cast<uint16_t*>(bytes.data());
+            for(size_t i = 0; i < count; i++) {
+                channels[3 * i] = static_cast<uint16_t>(pixels[i].red * 257);
+                channels[3 * i + 1] = static_cast<uint16_t>(pixels[i].green * 257);
+                channels[3 * i + 2] = static_cast<uint16_t>(pixels[i].blue * 257);
+            }
+            break;
+        }
+        case BenchSource::HDR: {
+            // Linear light up to 4, so the tone curve has highlights to compress.
+            bytes.resize(3 * count * sizeof(float));
+            auto* channels = reinterpret_cast<float*>(bytes.data());
+            for(size_t i = 0; i < count; i++) {
+                channels[3 * i] = 4.0f * SRGB_TO_LINEAR[pixels[i].red] / 65535;
+                channels[3 * i + 1] = 4.0f * SRGB_TO_LINEAR[pixels[i].green] / 65535;
+                channels[3 * i + 2] = 4.0f * SRGB_TO_LINEAR[pixels[i].blue] / 65535;
+            }
+            break;
+        }
+        case BenchSource::FRAMES:
+            // The RGBA image panning left a few pixels per frame.
+            bytes.resize(BENCH_FRAMES * 4 * count);
+            for(size_t frame = 0; frame < BENCH_FRAMES; frame++) {
+                uint8_t* out = bytes.data() + frame * 4 * count;
+                for(size_t y = 0; y < height; y++) {
+                    for(size_t x = 0; x < width; x++) {
+                        const Color& pixel = pixels[y * width + (x + 8 * frame) % width];
+                        uint8_t* rgba = out + 4 * (y * width + x);
+                        rgba[0] = pixel.red;
+                        rgba[1] = pixel.green;
+                        rgba[2] = pixel.blue;
+                        rgba[3] = test_alpha(x, width);
+                    }
+                }
+            }
+            break;
+    }
+
+    return bytes;
+}
+
+static void convert_source(BenchSource source, const Configuration& config, std::string& out, const std::unique_ptr<Color[]>& pixels, const std::vector<uint8_t>& bytes, size_t width, size_t height)
+{
+    switch(source) {
+        case BenchSource::RGB: doAsciiConversion(config, out, pixels, width, height); break;
+        case BenchSource::GRAY: doGrayConversion(config, out, bytes.data(), width, height); break;
+        case BenchSource::RGBA: doRgbaConversion(config, out, bytes.data(), width, height); break;
+        case BenchSource::DEEP:
+            doAsciiConversion(config, out, tone_map_16(config, reinterpret_cast<const uint16_t*>(bytes.data()), width * height), width, height);
+            break;
+        case BenchSource::HDR:
+            doAsciiConversion(config, out, tone_map_float(config, reinterpret_cast<const float*>(bytes.data()), width * height), width, height);
+            break;
+        case BenchSource::FRAMES:
+            for(const std::string& frame : convert_frames(config, bytes.data(), BENCH_FRAMES, width, height)) {
+                out += frame;
+            }
+            break;
+    }
+}
+
+static const std::array<BenchWorkload, 44> WORKLOADS { {
+    { "luma-1080p-w160", 1920, 1080, 160, [](Configuration&) { } },
+    { "perceived-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.perceived = true; } },
+    { "perceived-fast-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.alt = true; } },
+    { "inverted-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.inverted = true; } },
+    { "luma-480p-w640", 640, 480, 640, [](Configuration&) { } },
+    { "luma-12mp-w120", 4000, 3000, 120, [](Configuration&) { } },
+    { "truecolor-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.color_mode = ColorMode::TRUECOLOR; } },
+    { "truecolor-tol8-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.color_mode = ColorMode::TRUECOLOR; config.color_tolerance = 8; } },
+    { "edges-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.edges = true; } },
+    { "edges-12mp-w120", 4000, 3000, 120, [](Configuration& config) { config.edges = true; } },
+    { "shapes-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.shapes = true; } },
+    { "braille-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.unicode_mode = UnicodeMode::BRAILLE; } },
+    { "quadrants-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.unicode_mode = UnicodeMode::QUADRANTS; } },
+    { "half-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.unicode_mode = UnicodeMode::HALF_BLOCKS; } },
+    { "half-12mp-w120", 4000, 3000, 120, [](Configuration& config) { config.unicode_mode = UnicodeMode::HALF_BLOCKS; } },
+    { "dither-fs-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.dither_mode = DitherMode::FLOYD_STEINBERG; } },
+    { "dither-fs-saturated-w80", 800, 400, 80, [](Configuration& config) { config.rows = 40; config.dither_mode = DitherMode::FLOYD_STEINBERG; }, make_saturated_image },
+    { "dither-atkinson-saturated-w80", 800, 400, 80, [](Configuration& config) { config.rows = 40; config.dither_mode = DitherMode::ATKINSON; }, make_saturated_image },
+    { "dither-bayer-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.dither_mode = DitherMode::BAYER; } },
+    { "linear-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.linear = true; } },
+    { "equalize-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.contrast_mode = ContrastMode::EQUALIZE; } },
+    { "clahe-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.contrast_mode = ContrastMode::CLAHE; } },
+    { "median-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.reducer = CellReducer::MEDIAN; } },
+    { "max-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.reducer = CellReducer::MAX; } },
+    { "tone-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.contrast = 1.3; config.brightness = 0.05; config.gamma = 1.2; } },
+    { "sharpen-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.sharpen = 1; } },
+    { "sharpen-12mp-w120", 4000, 3000, 120, [](Configuration& config) { config.sharpen = 1; } },
+    { "area-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.filter = ResampleFilter::AREA; } },
+    { "lanczos-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.filter = ResampleFilter::LANCZOS; } },
+    { "luma-1080p-cell2x4", 1920, 1080, 960, [](Configuration& config) { config.rows = 135; } },
+    { "truecolor-1080p-cell8x4", 1920, 1080, 240, [](Configuration& config) { config.rows = 135; config.color_mode = ColorMode::TRUECOLOR; } },
+    { "quality1-12mp-w120", 4000, 3000, 120, [](Configuration& config) { config.quality = 1; } },
+    { "256color-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.color_mode = ColorMode::XTERM_256; } },
+    { "upscale-64px-w480", 64, 48, 480, [](Configuration&) { } },
+    { "upscale-bilinear-64px-w480", 64, 48, 480, [](Configuration& config) { config.upscale = UpscaleFilter::BILINEAR; } },
+    { "upscale-median-64px-w480", 64, 48, 480, [](Configuration& config) { config.reducer = CellReducer::MEDIAN; } },
+    { "upscale-edges-64px-w480", 64, 48, 480, [](Configuration& config) { config.edges = true; } },
+    { "gray-1080p-w160", 1920, 1080, 160, [](Configuration&) { }, make_test_image, BenchSource::GRAY },
+    { "gray-perceived-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.perceived = true; }, make_test_image, BenchSource::GRAY },
+    { "rgba-1080p-w160", 1920, 1080, 160, [](Configuration&) { }, make_test_image, BenchSource::RGBA },
+    { "rgba-truecolor-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.color_mode = ColorMode::TRUECOLOR; }, make_test_image, BenchSource::RGBA },
+    { "deep16-1080p-w160", 1920, 1080, 160, [](Configuration&) { }, make_test_image, BenchSource::DEEP },
+    { "hdr-filmic-1080p-w160", 1920, 1080, 160, [](Configuration& config) { config.tone_map = ToneMap::FILMIC; }, make_test_image, BenchSource::HDR },
+    { "frames8-480p-w80", 640, 480, 80, [](Configuration&) { }, make_test_image, BenchSource::FRAMES },
+} };
+
+// Passes that stand in for the plain conversion are held to a multiple of its time in the same
+// run, whatever the baselines say, so a slow pass cannot be committed along with its baseline.
+struct RelativeLimit
+{
+    std::string_view name;
+    std::string_view reference;
+    double factor;
+};
+
+static constexpr std::array<RelativeLimit, 4> RELATIVE_LIMITS { {
+    { "edges-1080p-w160", "luma-1080p-w160", 2.0 },
+    { "edges-12mp-w120", "luma-12mp-w120", 2.0 },
+    { "sharpen-1080p-w160", "luma-1080p-w160", 1.5 },
+    { "sharpen-12mp-w120", "luma-12mp-w120", 1.5 },
+} };
+
+// Edge workloads and the plain conversion of the same image. Edge glyphs only replace the
+// density glyph, so the two renders may differ in line glyphs and nowhere else.
+struct EdgeOverlay
+{
+    std::string_view name;
+    std::string_view plain;
+};
+
+static constexpr std::array<EdgeOverlay, 3> EDGE_OVERLAYS { {
+    { "edges-1080p-w160", "luma-1080p-w160" },
+    { "edges-12mp-w120", "luma-12mp-w120" },
+    { "upscale-edges-64px-w480", "upscale-64px-w480" },
+} };
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t hash = 0;
+    double median_ms = 0;
+    // Median over the runs of this workload's time over the reference's, timed alongside it.
+    double relative = 0;
+};
+
+// FNV-1a
+static uint64_t hash_bytes(const std::string& bytes)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(char c : bytes) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// A workload's configuration and source, built before any timing starts.
+struct PreparedWorkload
+{
+    const BenchWorkload& workload;
+    Configuration config;
+    std::unique_ptr<Color[]> pixels;
+    std::vector<uint8_t> source;
+
+    explicit PreparedWorkload(const BenchWorkload& bench)
+        : workload(bench), pixels(bench.image(bench.width, bench.height)), source(encode_source(bench.source, pixels.get(), bench.width, bench.height))
+    {
+        config.cols = bench.cols;
+        bench.setup(config);
+        normalize_dimensions(config, bench.width, bench.height);
+    }
+
+    void convert(std::string& out) const
+    {
+        convert_source(workload.source, config, out, pixels, source, workload.width, workload.height);
+    }
+};
+
+// Wall time of one call of `convert`, in milliseconds.
+template<typename Convert>
+static double time_ms(Convert&& convert)
+{
+    const auto start = std::chrono::steady_clock::now();
+    convert();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Renders of an edge overlay that differ other than by a line glyph, or -1 when they do not
+// line up cell for cell.
+static int64_t overlay_mismatches(const EdgeOverlay& overlay)
+{
+    const auto render = [](std::string_view name) {
+        const auto workload = std::find_if(WORKLOADS.begin(), WORKLOADS.end(), [name](const BenchWorkload& bench) { return bench.name == name; });
+        std::string ascii;
+        PreparedWorkload(*workload).convert(ascii);
+        return ascii;
+    };
+
+    const std::string edges = render(overlay.name);
+    const std::string plain = render(overlay.plain);
+    if(edges.size() != plain.size()) {
+        return -1;
+    }
+
+    int64_t mismatches = 0;
+    for(size_t i = 0; i < edges.size(); i++) {
+        if(edges[i] != plain[i] && std::string_view("|-_/\\").find(edges[i]) == std::string_view::npos) {
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+// Runs `workload`, adding each measured run of the reference to `reference_times`.
+static BenchResult run_workload(const BenchWorkload& workload, const PreparedWorkload& reference, std::vector<double>& reference_times)
+{
+    const PreparedWorkload prepared(workload);
+
+    std::vector<double> times;
+    std::vector<double> ratios;
+    std::string ascii;
+    std::string reference_ascii;
+
+    // One extra warm up run that is not measured.
+    for(size_t run = 0; run <= BENCH_RUNS; run++) {
+        // The reference runs right before every sample, so a machine that speeds up or slows
+        // down over the bench moves both sides of the ratio together.
+        reference_ascii.clear();
+        const double reference_ms = time_ms([&] { reference.convert(reference_ascii); });
+
+        ascii.clear();
+        const double ms = time_ms([&] { prepared.convert(ascii); });
+
+        if(run == 0) {
+            continue;
+        }
+
+        times.push_back(ms);
+        ratios.push_back(ms / reference_ms);
+        reference_times.push_back(reference_ms);
+    }
+
+    std::sort(times.begin(), times.end());
+    std::sort(ratios.begin(), ratios.end());
+
+    BenchResult result;
+    result.name = workload.name;
+    result.hash = hash_bytes(ascii);
+    result.median_ms = times[times.size() / 2];
+    result.relative = ratios[ratios.size() / 2];
+
+    return result;
+}
+
+static bool read_baselines(std::string_view path, std::map<std::string, BenchResult, std::less<>>& baselines)
+{
+    std::ifstream file(path.data());
+    if(!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    while(std::getline(file, line)) {
+        if(line.empty() || line.starts_with('#')) {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        BenchResult baseline;
+        fields >> baseline.name >> std::hex >> baseline.hash >> std::dec >> baseline.median_ms >> baseline.relative;
+        if(!fields) {
+            continue;
+        }
+
+        baselines[baseline.name] = baseline;
+    }
+
+    return true;
+}
+
+int run_benchmarks(std::ostream& out, std::string_view baseline_path)
+{
+    const auto reference_workload = std::find_if(WORKLOADS.begin(), WORKLOADS.end(), [](const BenchWorkload& workload) { return workload.name == REFERENCE_WORKLOAD; });
+    const PreparedWorkload reference_prepared(*reference_workload);
+
+    std::vector<BenchResult> results;
+    std::vector<double> reference_times;
+    for(const BenchWorkload& workload : WORKLOADS) {
+        results.push_back(run_workload(workload, reference_prepared, reference_times));
+    }
+
+    // The reference's own time is the median over every run of it, timed alongside each
+    // workload, so a moment of load on the machine does not decide it.
+    std::sort(reference_times.begin(), reference_times.end());
+    for(BenchResult& result : results) {
+        if(result.name == REFERENCE_WORKLOAD) {
+            result.median_ms = reference_times[reference_times.size() / 2];
+        }
+    }
+
+    out << std::fixed << std::setprecision(3);
+
+    if(baseline_path.empty()) {
+        out << "# name hash median_ms relative_to_" << REFERENCE_WORKLOAD << '\n';
+        for(const BenchResult& result : results) {
+            out << result.name << ' ' << std::hex << std::setw(16) << std::setfill('0') << result.hash << std::dec << std::setfill(' ') << ' '
+                << result.median_ms << ' ' << result.relative << '\n';
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    std::map<std::string, BenchResult, std::less<>> baselines;
+    if(!read_baselines(baseline_path, baselines)) {
+        out << "Could not open " << baseline_path << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const auto find_result = [&results](std::string_view name) {
+        return std::find_if(results.begin(), results.end(), [name](const BenchResult& result) { return result.name == name; });
+    };
+
+    size_t failures = 0;
+
+    for(const BenchResult& result : results) {
+        out << std::left << std::setw(28) << result.name << std::right << std::setw(10) << result.median_ms << " ms  ";
+
+        const auto baseline = baselines.find(result.name);
+        if(baseline == baselines.end()) {
+            out << "no baseline\n";
+            continue;
+        }
+
+        const BenchResult& expected = baseline->second;
+        bool failed = false;
+
+        if(result.hash != expected.hash) {
+            out << "FAIL output changed (hash " << std::hex << expected.hash << " -> " << result.hash << std::dec << ") ";
+            failed = true;
+        }
+
+        if(result.name == REFERENCE_WORKLOAD) {
+            // Against the machine the baselines were recorded on.
+            const double factor = result.median_ms / expected.median_ms;
+            if(factor > TIME_TOLERANCE) {
+                out << "FAIL time regressed " << std::setprecision(2) << factor << "x (" << std::setprecision(3) << expected.median_ms << " -> " << result.median_ms << " ms, limit " << std::setprecision(2) << TIME_TOLERANCE << "x) ";
+                failed = true;
+            } else {
+                out << "time " << std::setprecision(2) << factor << "x ";
+            }
+        } else {
+            // Each run's time over the reference's, timed right before it, against the same
+            // ratio in the baseline.
+            const double factor = result.relative / expected.relative;
+            if(factor > TIME_TOLERANCE) {
+                out << "FAIL time regressed " << std::setprecision(2) << factor << "x relative to " << REFERENCE_WORKLOAD << " (" << expected.relative << " -> " << result.relative << ", limit " << TIME_TOLERANCE << "x) ";
+                failed = true;
+            } else {
+                out << "time " << std::setprecision(2) << factor << "x ";
+            }
+        }
+
+        out << std::setprecision(3) << (failed ? "\n" : "ok\n");
+        failures += failed ? 1 : 0;
+    }
+
+    for(const RelativeLimit& limit : RELATIVE_LIMITS) {
+        const auto result = find_result(limit.name);
+        const auto base = find_result(limit.reference);
+        if(result == results.end() || base == results.end() || base->relative <= 0) {
+            continue;
+        }
+
+        const double factor = result->relative / base->relative;
+        out << std::left << std::setw(28) << limit.name << std::right << std::setprecision(2) << std::setw(10) << factor << "x " << limit.reference << "  ";
+        if(factor > limit.factor) {
+            out << "FAIL over " << limit.factor << "x\n";
+            failures++;
+        } else {
+            out << "ok\n";
+        }
+        out << std::setprecision(3);
+    }
+
+    for(const EdgeOverlay& overlay : EDGE_OVERLAYS) {
+        const int64_t mismatches = overlay_mismatches(overlay);
+        out << std::left << std::setw(28) << overlay.name << std::right << " over " << overlay.plain << "  ";
+        if(mismatches != 0) {
+            out << "FAIL " << (mismatches < 0 ? std::string("renders do not line up") : std::to_string(mismatches) + " cells differ other than by a line glyph") << '\n';
+            failures++;
+        } else {
+            out << "ok\n";
+        }
+    }
+
+    if(failures != 0) {
+        out << failures << " of " << results.size() << " workloads regressed (tolerance " << TIME_TOLERANCE << "x time)\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int run_palette_benchmark(std::ostream& out)
+{
+    // Every third value per channel, including both ends of the range.
+    std::vector<Color> colors;
+    for(int red = 0; red < 256; red += 3) {
+        for(int green = 0; green < 256; green += 3) {
+            for(int blue = 0; blue < 256; blue += 3) {
+                colors.push_back({ static_cast<uint8_t>(red), static_cast<uint8_t>(green), static_cast<uint8_t>(blue) });
+            }
+        }
+    }
+
+    std::vector<uint8_t> exact(colors.size());
+    std::vector<uint8_t> table(colors.size());
+
+    const auto time_ns = [&colors](std::vector<uint8_t>& indices, uint8_t (*quantize)(const Color&)) {
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < colors.size(); i++) {
+            indices[i] = quantize(colors[i]);
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return elapsed / static_cast<double>(colors.size());
+    };
+
+    const double exact_ns = time_ns(exact, nearest_xterm_index);
+    const double table_ns = time_ns(table, xterm_index);
+
+    size_t mismatches = 0;
+    double error_sum = 0;
+    double error_max = 0;
+
+    for(size_t i = 0; i < colors.size(); i++) {
+        if(exact[i] == table[i]) {
+            continue;
+        }
+
+        mismatches++;
+
+        // Extra RGB distance paid for taking the table's answer.
+        const double error = std::sqrt(xterm_distance_squared(colors[i], table[i])) - std::sqrt(xterm_distance_squared(colors[i], exact[i]));
+        error_sum += error;
+        error_max = std::max(error_max, error);
+    }
+
+    out << std::fixed << std::setprecision(2);
+    out << "colours sampled     " << colors.size() << '\n';
+    out << "exhaustive search   " << exact_ns << " ns/colour\n";
+    out << "lookup table        " << table_ns << " ns/colour\n";
+    out << "exact matches       " << 100.0 * static_cast<double>(colors.size() - mismatches) / static_cast<double>(colors.size()) << "%\n";
+    out << "extra distance      mean " << (mismatches == 0 ? 0 : error_sum / static_cast<double>(mismatches)) << ", max " << error_max << " (RGB units, mismatches only)\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <string_view>
+
+// Renders a fixed set of synthetic workloads through the converter and records, per workload,
+// a hash of the output bytes, the median wall time and the median ratio of its time to a
+// reference workload (the plain conversion) timed right before it.
+//
+// Without a baseline the results are printed in baseline format, so
+//     ascii --bench > bench/baselines-RelWithDebInfo.txt
+// refreshes the committed baselines of that build type. With one, the run fails for any
+// workload whose output changed, for the reference if its time grew past 1.5 times the
+// baseline's, and for any other workload whose time ratio to the reference did. The reference's
+// own time only holds on the machine the baselines came from, and no time holds across
+// compilers or optimisation levels, so there is one baseline file per build type, recorded on
+// the machine that runs the check. A few passes are also held to a multiple of the plain
+// conversion's time in the same run.
+int run_benchmarks(std::ostream& out, std::string_view baseline_path);
+
+// Compares the xterm-256 lookup table against the exhaustive nearest search: speed, how often
+// they agree and how much further the table's pick is when they do not.
+int run_palette_benchmark(std::ostream& out);
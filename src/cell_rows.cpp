@@ -0,0 +1,468 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "cell_rows.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "luma.hpp"
+
+// Perceived luma of each grey level, exactly the value the RGB path sums for that pixel.
+static const std::array<double, 256> PERCEIVED_GREY = [] {
+    std::array<double, 256> table { };
+    for(size_t level = 0; level < table.size(); level++) {
+        const auto grey = static_cast<uint8_t>(level);
+        table[level] = perceived_luma({ grey, grey, grey });
+    }
+    return table;
+}();
+
+// Channel sums of GROUP side by side WIDTH x HEIGHT cells at `top`, `stride` bytes between
+// source rows. Every loop is over compile time bounds, so they unroll completely: the HEIGHT
+// rows are added lane by lane into 16 bit lanes (255 * 16 still fits), a straight vertical add
+// the compiler turns into SIMD, and the lanes are then folded horizontally into each cell's
+// three channels.
+template<size_t WIDTH, size_t HEIGHT, size_t GROUP>
+static void reduce_group(const uint8_t* top, size_t stride, uint64_t* sums)
+{
+    static_assert(HEIGHT <= 16, "16 bit lanes would overflow");
+    static constexpr size_t LANES = 3 * WIDTH * GROUP;
+
+    uint16_t lanes[LANES] { };
+    for(size_t y = 0; y < HEIGHT; y++) {
+        for(size_t i = 0; i < LANES; i++) {
+            lanes[i] = static_cast<uint16_t>(lanes[i] + top[y * stride + i]);
+        }
+    }
+
+    for(size_t g = 0; g < GROUP; g++) {
+        uint32_t red = 0;
+        uint32_t green = 0;
+        uint32_t blue = 0;
+        for(size_t x = g * WIDTH; x < (g + 1) * WIDTH; x++) {
+            red += lanes[3 * x];
+            green += lanes[3 * x + 1];
+            blue += lanes[3 * x + 2];
+        }
+
+        sums[3 * g] = red;
+        sums[3 * g + 1] = green;
+        sums[3 * g + 2] = blue;
+    }
+}
+
+// Narrow cells are taken several at a time so each vertical add covers at least 24 bytes.
+template<size_t WIDTH, size_t HEIGHT>
+static void reduce_cells(const uint8_t* top, size_t stride, size_t cells, uint64_t* sums)
+{
+    static constexpr size_t GROUP = WIDTH < 8 ? 8 / WIDTH : 1;
+
+    size_t c = 0;
+    for(; c + GROUP <= cells; c += GROUP) {
+        reduce_group<WIDTH, HEIGHT, GROUP>(top + 3 * WIDTH * c, stride, sums + 3 * c);
+    }
+
+    for(; c < cells; c++) {
+        reduce_group<WIDTH, HEIGHT, 1>(top + 3 * WIDTH * c, stride, sums + 3 * c);
+    }
+}
+
+template<size_t WIDTH>
+static CellRowAccumulator::CellKernel kernel_for_height(size_t height)
+{
+    switch(height) {
+    case 1: return reduce_cells<WIDTH, 1>;
+    case 2: return reduce_cells<WIDTH, 2>;
+    case 4: return reduce_cells<WIDTH, 4>;
+    case 8: return reduce_cells<WIDTH, 8>;
+    case 16: return reduce_cells<WIDTH, 16>;
+    default: return nullptr;
+    }
+}
+
+static CellRowAccumulator::CellKernel cell_kernel(size_t width, size_t height)
+{
+    switch(width) {
+    case 1: return kernel_for_height<1>(height);
+    case 2: return kernel_for_height<2>(height);
+    case 4: return kernel_for_height<4>(height);
+    case 8: return kernel_for_height<8>(height);
+    default: return nullptr;
+    }
+}
+
+// Common step of an evenly spaced span list, or 0 when the cell size is not integral.
+static size_t integral_step(const CellSpans& spans)
+{
+    if(spans.size() == 0) {
+        return 0;
+    }
+
+    const size_t step = spans.end[0] - spans.begin[0];
+    for(size_t i = 0; i < spans.size(); i++) {
+        if(spans.begin[i] != i * step) {
+            return 0;
+        }
+    }
+
+    return step;
+}
+
+// Plain bytes into their column sums: a widening add the compiler can vectorize once it knows
+// the two cannot alias. The blocks have a compile time length so -O2 vectorizes them too; left
+// scalar, the loop ran at one byte a cycle and its speed hung on where the linker placed it.
+static void add_bytes(const uint8_t* __restrict bytes, size_t size, uint32_t* __restrict sums)
+{
+    static constexpr size_t BLOCK = 16;
+
+    size_t i = 0;
+    for(; i + BLOCK <= size; i += BLOCK) {
+        for(size_t j = 0; j < BLOCK; j++) {
+            sums[i + j] += bytes[i + j];
+        }
+    }
+    for(; i < size; i++) {
+        sums[i] += bytes[i];
+    }
+}
+
+CellRowAccumulator::CellRowAccumulator(const Configuration& configuration, const std::unique_ptr<Color[]>& image, size_t img_width, const CellSpans& cell_columns, const CellSpans& cell_rows, bool with_color)
+    : config(configuration), pixels(reinterpret_cast<const uint8_t*>(image.get())), channels(3), width(img_width), columns(cell_columns), rows(cell_rows),
+      cell_sums(3 * cell_columns.size()), cell_luminance(cell_columns.size()), cell_colors(cell_columns.size())
+{
+    if(config.linear) {
+        linear_sums.resize(3 * img_width);
+        return;
+    }
+
+    if(config.perceived && !config.alt) {
+        luma_sums.resize(cell_columns.size());
+    }
+
+    // Perceived luma does not come from the channel totals, so without colour they are skipped.
+    if(with_color || luma_sums.empty()) {
+        channel_sums.resize(3 * img_width);
+    }
+
+    // Perceived luma still needs every pixel, so only the channel derived modes take a kernel.
+    if(luma_sums.empty()) {
+        kernel_width = integral_step(columns);
+        kernel_height = integral_step(rows);
+        kernel = cell_kernel(kernel_width, kernel_height);
+    }
+}
+
+CellRowAccumulator::CellRowAccumulator(const Configuration& configuration, const uint8_t* plane, size_t plane_channels, size_t img_width, const CellSpans& cell_columns, const CellSpans& cell_rows)
+    : config(configuration), pixels(plane), channels(plane_channels), width(img_width), columns(cell_columns), rows(cell_rows),
+      cell_sums(3 * cell_columns.size()), cell_luminance(cell_columns.size()), cell_colors(cell_columns.size())
+{
+    if(channels == 4) {
+        cell_alpha.resize(cell_columns.size());
+        cell_transparent.resize(cell_columns.size());
+
+        if(config.linear) {
+            linear_sums.resize(4 * img_width);
+            return;
+        }
+
+        // Alpha weighted channels reach 255 * 255 per pixel, so a 32 bit column sum holds
+        // 66051 rows, far more than any cell.
+        channel_sums.resize(4 * img_width);
+        if(config.perceived && !config.alt) {
+            luma_sums.resize(cell_columns.size());
+        }
+        return;
+    }
+
+    // The linear luma modes weigh the channels to a total of one, so a grey pixel's luma is its
+    // level. Perceived luma is summed per pixel as for RGB, so both give the same cells.
+    if(config.linear) {
+        linear_sums.resize(img_width);
+    } else {
+        channel_sums.resize(img_width);
+        if(config.perceived && !config.alt) {
+            luma_sums.resize(cell_columns.size());
+        }
+    }
+}
+
+void CellRowAccumulator::add_rgba_row(const uint8_t* source)
+{
+    if(config.linear) {
+        for(size_t x = 0; x < width; x++) {
+            const uint64_t alpha = source[4 * x + 3];
+            linear_sums[4 * x] += SRGB_TO_LINEAR[source[4 * x]] * alpha;
+            linear_sums[4 * x + 1] += SRGB_TO_LINEAR[source[4 * x + 1]] * alpha;
+            linear_sums[4 * x + 2] += SRGB_TO_LINEAR[source[4 * x + 2]] * alpha;
+            linear_sums[4 * x + 3] += alpha;
+        }
+        return;
+    }
+
+    uint32_t* __restrict sums = channel_sums.data();
+    for(size_t x = 0; x < width; x++) {
+        const uint32_t alpha = source[4 * x + 3];
+        sums[4 * x] += source[4 * x] * alpha;
+        sums[4 * x + 1] += source[4 * x + 1] * alpha;
+        sums[4 * x + 2] += source[4 * x + 2] * alpha;
+        sums[4 * x + 3] += alpha;
+    }
+
+    // Perceived luma is not a weighted sum, so each pixel is composited before taking it.
+    if(!luma_sums.empty()) {
+        const Color& background = config.background;
+
+        for(size_t c = 0; c < columns.size(); c++) {
+            double sum = luma_sums[c];
+            for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                const uint8_t* pixel = source + 4 * x;
+                const uint32_t alpha = pixel[3];
+
+                if(config.alpha_weighted) {
+                    sum += perceived_luma({ pixel[0], pixel[1], pixel[2] }) * alpha;
+                } else {
+                    const auto over = [&](uint8_t channel, uint8_t back) {
+                        return static_cast<uint8_t>((channel * alpha + back * (255 - alpha) + 127) / 255);
+                    };
+                    sum += perceived_luma({ over(pixel[0], background.red), over(pixel[1], background.green), over(pixel[2], background.blue) });
+                }
+            }
+            luma_sums[c] = sum;
+        }
+    }
+}
+
+void CellRowAccumulator::add_row(const uint8_t* source)
+{
+    if(channels == 4) {
+        add_rgba_row(source);
+        return;
+    }
+
+    if(config.linear) {
+        for(size_t i = 0; i < linear_sums.size(); i++) {
+            linear_sums[i] += SRGB_TO_LINEAR[source[i]];
+        }
+        return;
+    }
+
+    add_bytes(source, channel_sums.size(), channel_sums.data());
+
+    // Summed straight into the cell, which keeps each cell's square roots in one dependency
+    // chain the out of order core can overlap with the next cell's.
+    if(!luma_sums.empty() && channels == 1) {
+        for(size_t c = 0; c < columns.size(); c++) {
+            double sum = luma_sums[c];
+            for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                sum += PERCEIVED_GREY[source[x]];
+            }
+            luma_sums[c] = sum;
+        }
+    } else if(!luma_sums.empty()) {
+        const auto* colors = reinterpret_cast<const Color*>(source);
+        for(size_t c = 0; c < columns.size(); c++) {
+            double sum = luma_sums[c];
+            for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                sum += perceived_luma(colors[x]);
+            }
+            luma_sums[c] = sum;
+        }
+    }
+}
+
+void CellRowAccumulator::gather_row()
+{
+    const size_t row_height = rows.end[row] - rows.begin[row];
+
+    if(kernel != nullptr && row_height == kernel_height) {
+        // Cut short cells (the last column when the width is not a multiple) are summed by hand.
+        const size_t whole = std::min(columns.size(), width / kernel_width);
+        kernel(pixels + 3 * rows.begin[row] * width, 3 * width, whole, cell_sums.data());
+
+        for(size_t c = whole; c < columns.size(); c++) {
+            uint64_t* sums = &cell_sums[3 * c];
+            sums[0] = sums[1] = sums[2] = 0;
+
+            for(size_t y = rows.begin[row]; y < rows.end[row]; y++) {
+                for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                    const Color& pixel = reinterpret_cast<const Color*>(pixels)[y * width + x];
+                    sums[0] += pixel.red;
+                    sums[1] += pixel.green;
+                    sums[2] += pixel.blue;
+                }
+            }
+        }
+        return;
+    }
+
+    std::fill(channel_sums.begin(), channel_sums.end(), 0);
+    std::fill(linear_sums.begin(), linear_sums.end(), 0);
+    std::fill(luma_sums.begin(), luma_sums.end(), 0.0);
+
+    for(size_t y = rows.begin[row]; y < rows.end[row]; y++) {
+        add_row(pixels + channels * y * width);
+    }
+
+    for(size_t c = 0; c < columns.size(); c++) {
+        uint64_t* sums = &cell_sums[3 * c];
+        sums[0] = sums[1] = sums[2] = 0;
+
+        if(channels == 4) {
+            const uint64_t* linear = linear_sums.data();
+            const uint32_t* plain = channel_sums.data();
+            uint64_t alpha = 0;
+
+            for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                for(size_t channel = 0; channel < 3; channel++) {
+                    sums[channel] += config.linear ? linear[4 * x + channel] : plain[4 * x + channel];
+                }
+                alpha += config.linear ? linear[4 * x + 3] : plain[4 * x + 3];
+            }
+
+            cell_alpha[c] = alpha;
+            continue;
+        }
+
+        if(channels == 1) {
+            for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                sums[0] += config.linear ? linear_sums[x] : channel_sums[x];
+            }
+            sums[1] = sums[2] = sums[0];
+            continue;
+        }
+
+        for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+            if(config.linear) {
+                sums[0] += linear_sums[3 * x];
+                sums[1] += linear_sums[3 * x + 1];
+                sums[2] += linear_sums[3 * x + 2];
+            } else if(!channel_sums.empty()) {
+                sums[0] += channel_sums[3 * x];
+                sums[1] += channel_sums[3 * x + 1];
+                sums[2] += channel_sums[3 * x + 2];
+            }
+        }
+    }
+}
+
+bool CellRowAccumulator::next()
+{
+    if(row == rows.size()) {
+        return false;
+    }
+
+    gather_row();
+
+    const uint64_t row_height = rows.end[row] - rows.begin[row];
+
+    for(size_t c = 0; c < columns.size(); c++) {
+        const uint64_t count = row_height * (columns.end[c] - columns.begin[c]);
+
+        if(count == 0) {
+            cell_luminance[c] = 0;
+            cell_colors[c] = { };
+            continue;
+        }
+
+        if(channels == 4) {
+            finish_rgba_cell(c, count);
+            continue;
+        }
+
+        const uint64_t* sums = &cell_sums[3 * c];
+
+        if(config.linear) {
+            cell_colors[c] = linear_mean(sums, count);
+            cell_luminance[c] = configured_luma(config, cell_colors[c]);
+            continue;
+        }
+
+        cell_colors[c] = {
+            static_cast<uint8_t>((sums[0] + count / 2) / count),
+            static_cast<uint8_t>((sums[1] + count / 2) / count),
+            static_cast<uint8_t>((sums[2] + count / 2) / count),
+        };
+
+        const auto pixel_count = static_cast<double>(count);
+        if(!luma_sums.empty()) {
+            cell_luminance[c] = luma_sums[c] / pixel_count;
+        } else {
+            // The linear luma modes are weighted sums, so the channel totals give them exactly.
+            const bool alt = config.alt;
+            const double red = static_cast<double>(sums[0]) * (alt ? RED_WEIGHT_PERC : RED_WEIGHT);
+            const double green = static_cast<double>(sums[1]) * (alt ? GREEN_WEIGHT_PERC : GREEN_WEIGHT);
+            const double blue = static_cast<double>(sums[2]) * (alt ? BLUE_WEIGHT_PERC : BLUE_WEIGHT);
+
+            cell_luminance[c] = (red + green + blue) / LUMA_MAX / pixel_count;
+        }
+    }
+
+    row++;
+    return true;
+}
+
+void CellRowAccumulator::finish_rgba_cell(size_t c, uint64_t count)
+{
+    const uint64_t alpha = cell_alpha[c];
+    cell_transparent[c] = alpha == 0 ? 1 : 0;
+
+    if(alpha == 0) {
+        cell_luminance[c] = 0;
+        cell_colors[c] = config.background;
+        return;
+    }
+
+    // Mean of each channel in the source encoding (sRGB levels, or 16 bit linear light with
+    // -l), either over the visible pixels only or with the uncovered part of the cell filled
+    // in by the background.
+    const Color& background = config.background;
+    const uint8_t back[3] { background.red, background.green, background.blue };
+    const auto covered = static_cast<double>(alpha);
+    const double full = 255.0 * static_cast<double>(count);
+
+    double mean[3];
+    for(size_t channel = 0; channel < 3; channel++) {
+        const auto sum = static_cast<double>(cell_sums[3 * c + channel]);
+        const double fill = config.linear ? SRGB_TO_LINEAR[back[channel]] : back[channel];
+        mean[channel] = config.alpha_weighted ? sum / covered : (sum + fill * (full - covered)) / full;
+    }
+
+    if(config.linear) {
+        const uint64_t linear[3] {
+            static_cast<uint64_t>(std::lround(mean[0])),
+            static_cast<uint64_t>(std::lround(mean[1])),
+            static_cast<uint64_t>(std::lround(mean[2])),
+        };
+        cell_colors[c] = linear_mean(linear, 1);
+        cell_luminance[c] = configured_luma(config, cell_colors[c]);
+        return;
+    }
+
+    cell_colors[c] = {
+        static_cast<uint8_t>(std::lround(mean[0])),
+        static_cast<uint8_t>(std::lround(mean[1])),
+        static_cast<uint8_t>(std::lround(mean[2])),
+    };
+
+    if(!luma_sums.empty()) {
+        cell_luminance[c] = luma_sums[c] / (config.alpha_weighted ? covered : static_cast<double>(count));
+    } else {
+        const bool alt = config.alt;
+        cell_luminance[c] = (mean[0] * (alt ? RED_WEIGHT_PERC : RED_WEIGHT) + mean[1] * (alt ? GREEN_WEIGHT_PERC : GREEN_WEIGHT) + mean[2] * (alt ? BLUE_WEIGHT_PERC : BLUE_WEIGHT)) / LUMA_MAX;
+    }
+}
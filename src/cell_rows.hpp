@@ -0,0 +1,82 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Mean luma and colour of each cell, one character row at a time, reading the image in memory
+// order: every source row is read once, front to back, and added into per pixel column
+// accumulators, and the character row is finished by summing those columns per cell once its
+// last source row has been added. Channel sums are exact integers and the linear luma modes
+// are weighted sums of the channels, so their cell luma comes from the channel totals and
+// needs no per pixel floating point work; only perceived luma (a square root) is summed per
+// pixel, straight into its cell. When both cell dimensions are small integers (1, 2, 4 or 8
+// wide by 1 to 16 tall) a kernel specialized for that size sums each cell directly instead.
+// Grayscale sources are read one byte per pixel, their single sum standing in for all three
+// channels. RGBA sources sum each channel weighted by its alpha, plus the alpha itself, and
+// each cell is then composited over `config.background` or, with `config.alpha_weighted`,
+// divided by its total alpha; cells with no alpha at all are flagged transparent.
+class CellRowAccumulator
+{
+public:
+    // Channel sums of `cells` whole cells from the top left of the first one.
+    using CellKernel = void (*)(const uint8_t* top, size_t stride, size_t cells, uint64_t* sums);
+
+    CellRowAccumulator(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, const CellSpans& columns, const CellSpans& rows, bool with_color);
+    // `channels` is 1 (grey) or 4 (RGBA).
+    CellRowAccumulator(const Configuration& config, const uint8_t* plane, size_t channels, size_t img_width, const CellSpans& columns, const CellSpans& rows);
+
+    // Averages the next character row, returns false once every row has been consumed.
+    bool next();
+
+    const std::vector<double>& luminance() const { return cell_luminance; }
+    const std::vector<Color>& colors() const { return cell_colors; }
+
+    // Non-zero for cells of an RGBA source without a single visible pixel; empty otherwise.
+    const std::vector<uint8_t>& transparent() const { return cell_transparent; }
+
+private:
+    void add_row(const uint8_t* source);
+    void add_rgba_row(const uint8_t* source);
+    void finish_rgba_cell(size_t c, uint64_t count);
+    void gather_row();
+
+    const Configuration& config;
+    const uint8_t* pixels;
+    size_t channels;
+    size_t width;
+    const CellSpans& columns;
+    const CellSpans& rows;
+    size_t row = 0;
+
+    CellKernel kernel = nullptr;
+    size_t kernel_width = 0;
+    size_t kernel_height = 0;
+
+    std::vector<uint32_t> channel_sums;
+    std::vector<uint64_t> linear_sums;
+    std::vector<double> luma_sums;
+    std::vector<uint64_t> cell_sums;
+    std::vector<uint64_t> cell_alpha;
+    std::vector<uint8_t> cell_transparent;
+    std::vector<double> cell_luminance;
+    std::vector<Color> cell_colors;
+};
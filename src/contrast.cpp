@@ -0,0 +1,165 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "contrast.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr size_t CLAHE_TILES = 8;
+
+static constexpr double STRETCH_LOW = 0.01;
+static constexpr double STRETCH_HIGH = 0.99;
+
+// Cumulative distribution at each bin edge, with the counts given as floats so clipped
+// histograms can carry fractional redistribution.
+static void cumulative_curve(const std::array<double, HISTOGRAM_BINS>& counts, std::array<float, HISTOGRAM_BINS + 1>& curve)
+{
+    double total = 0;
+    for(double count : counts) {
+        total += count;
+    }
+
+    if(total == 0) {
+        for(size_t i = 0; i <= HISTOGRAM_BINS; i++) {
+            curve[i] = static_cast<float>(i) / HISTOGRAM_BINS;
+        }
+        return;
+    }
+
+    double running = 0;
+    curve[0] = 0;
+    for(size_t i = 0; i < HISTOGRAM_BINS; i++) {
+        running += counts[i];
+        curve[i + 1] = static_cast<float>(running / total);
+    }
+}
+
+static void stretch_curve(const LumaHistogram& histogram, std::array<float, HISTOGRAM_BINS + 1>& curve)
+{
+    uint64_t total = 0;
+    for(uint32_t count : histogram) {
+        total += count;
+    }
+
+    // First bin edge at or past the low percentile, and last one at or before the high one.
+    size_t low = 0;
+    size_t high = HISTOGRAM_BINS;
+    uint64_t running = 0;
+    for(size_t i = 0; i < HISTOGRAM_BINS; i++) {
+        if(static_cast<double>(running) <= STRETCH_LOW * static_cast<double>(total)) {
+            low = i;
+        }
+
+        running += histogram[i];
+
+        if(static_cast<double>(running) >= STRETCH_HIGH * static_cast<double>(total)) {
+            high = i + 1;
+            break;
+        }
+    }
+
+    const double span = static_cast<double>(std::max<size_t>(1, high - low));
+    for(size_t i = 0; i <= HISTOGRAM_BINS; i++) {
+        curve[i] = static_cast<float>(std::clamp((static_cast<double>(i) - static_cast<double>(low)) / span, 0.0, 1.0));
+    }
+}
+
+ContrastMap::ContrastMap(const Configuration& config, const std::vector<float>& luminance, const LumaHistogram& histogram, size_t columns_count, size_t rows_count)
+    : columns(columns_count), rows(rows_count)
+{
+    if(config.contrast_mode == ContrastMode::STRETCH) {
+        curves.resize(1);
+        stretch_curve(histogram, curves[0]);
+        return;
+    }
+
+    if(config.contrast_mode == ContrastMode::EQUALIZE) {
+        std::array<double, HISTOGRAM_BINS> counts { };
+        std::copy(histogram.begin(), histogram.end(), counts.begin());
+
+        curves.resize(1);
+        cumulative_curve(counts, curves[0]);
+        return;
+    }
+
+    tiles_x = std::clamp<size_t>(columns, 1, CLAHE_TILES);
+    tiles_y = std::clamp<size_t>(rows, 1, CLAHE_TILES);
+    curves.resize(tiles_x * tiles_y);
+
+    // Tile histograms come from the cell grid, which is far smaller than the image.
+    for(size_t tile_y = 0; tile_y < tiles_y; tile_y++) {
+        for(size_t tile_x = 0; tile_x < tiles_x; tile_x++) {
+            std::array<double, HISTOGRAM_BINS> counts { };
+            double total = 0;
+
+            for(size_t row = tile_y * rows / tiles_y; row < (tile_y + 1) * rows / tiles_y; row++) {
+                for(size_t col = tile_x * columns / tiles_x; col < (tile_x + 1) * columns / tiles_x; col++) {
+                    counts[histogram_bin(static_cast<double>(luminance[row * columns + col]))]++;
+                    total++;
+                }
+            }
+
+            const double limit = std::max(1.0, config.clahe_limit * total / HISTOGRAM_BINS);
+            double excess = 0;
+            for(double& count : counts) {
+                if(count > limit) {
+                    excess += count - limit;
+                    count = limit;
+                }
+            }
+
+            for(double& count : counts) {
+                count += excess / HISTOGRAM_BINS;
+            }
+
+            cumulative_curve(counts, curves[tile_y * tiles_x + tile_x]);
+        }
+    }
+}
+
+double ContrastMap::lookup(const Curve& curve, double luminance)
+{
+    const double position = std::clamp(luminance, 0.0, 1.0) * HISTOGRAM_BINS;
+    const size_t bin = std::min(HISTOGRAM_BINS - 1, static_cast<size_t>(position));
+    const double fraction = position - static_cast<double>(bin);
+
+    return static_cast<double>(curve[bin]) + fraction * static_cast<double>(curve[bin + 1] - curve[bin]);
+}
+
+double ContrastMap::apply(double luminance, size_t row, size_t col) const
+{
+    if(curves.size() == 1) {
+        return lookup(curves[0], luminance);
+    }
+
+    // Position in tile units, measured from the first tile's centre.
+    const auto tile_position = [](size_t cell, size_t cells, size_t tiles, size_t& first, size_t& second) {
+        const double position = std::max(0.0, (static_cast<double>(cell) + 0.5) * static_cast<double>(tiles) / static_cast<double>(cells) - 0.5);
+        first = std::min(tiles - 1, static_cast<size_t>(position));
+        second = std::min(tiles - 1, first + 1);
+        return std::min(1.0, position - static_cast<double>(first));
+    };
+
+    size_t x0, x1, y0, y1;
+    const double wx = tile_position(col, columns, tiles_x, x0, x1);
+    const double wy = tile_position(row, rows, tiles_y, y0, y1);
+
+    const double top = (1 - wx) * lookup(curves[y0 * tiles_x + x0], luminance) + wx * lookup(curves[y0 * tiles_x + x1], luminance);
+    const double bottom = (1 - wx) * lookup(curves[y1 * tiles_x + x0], luminance) + wx * lookup(curves[y1 * tiles_x + x1], luminance);
+
+    return (1 - wy) * top + wy * bottom;
+}
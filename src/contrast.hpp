@@ -0,0 +1,63 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "conversion.hpp"
+
+static constexpr size_t HISTOGRAM_BINS = 256;
+
+using LumaHistogram = std::array<uint32_t, HISTOGRAM_BINS>;
+
+inline size_t histogram_bin(double luminance)
+{
+    return std::min(HISTOGRAM_BINS - 1, static_cast<size_t>(std::max(0.0, luminance) * HISTOGRAM_BINS));
+}
+
+// Remaps cell luminance so low-contrast images use the whole density ramp. Works on the
+// cells' mean luma rather than on pixels, since that is what picks the glyphs.
+//
+// STRETCH maps the 1st-99th percentile range onto [0, 1]; EQUALIZE maps through the
+// histogram's cumulative distribution; CLAHE equalizes tiles of cells separately, clipping
+// each tile's histogram at `config.clahe_limit` times its mean bin to bound the gain, and
+// blends the four nearest tiles' curves so tile borders do not show. Curves are piecewise
+// linear between bin edges, so equal inputs inside a bin are not flattened.
+class ContrastMap
+{
+public:
+    // `luminance` holds one value per cell, row major over columns x rows, and `histogram` the
+    // same values binned with histogram_bin.
+    ContrastMap(const Configuration& config, const std::vector<float>& luminance, const LumaHistogram& histogram, size_t columns, size_t rows);
+
+    double apply(double luminance, size_t row, size_t col) const;
+
+private:
+    using Curve = std::array<float, HISTOGRAM_BINS + 1>;
+
+    static double lookup(const Curve& curve, double luminance);
+
+    size_t columns;
+    size_t rows;
+    size_t tiles_x = 1;
+    size_t tiles_y = 1;
+    std::vector<Curve> curves;
+};
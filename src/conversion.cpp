@@ -0,0 +1,633 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "conversion.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+
+#include "alpha.hpp"
+#include "ansi_color.hpp"
+#include "cell_rows.hpp"
+#include "contrast.hpp"
+#include "dither.hpp"
+#include "edges.hpp"
+#include "half_blocks.hpp"
+#include "luma.hpp"
+#include "progressive.hpp"
+#include "reducers.hpp"
+#include "resample.hpp"
+#include "shapes.hpp"
+#include "sharpen.hpp"
+#include "tone.hpp"
+#include "trace.hpp"
+#include "unicode.hpp"
+#include "upscale.hpp"
+
+// When `average_color` is given the cell's mean RGB is gathered in the same pass. With
+// `config.linear` the channels are averaged in linear light and the luma is taken from the
+// re-encoded mean.
+constexpr double average_luma(const Configuration& config, const std::unique_ptr<Color[]>& pixels, const Quad& region, size_t img_width, size_t img_height, Color* average_color = nullptr)
+{
+    double luma_accumulator = 0;
+    double pixel_count = 0;
+    uint64_t color_accumulator[3] { };
+
+    for(size_t y = static_cast<size_t>(region.top_left_y); y < std::min(img_height, static_cast<size_t>(region.top_left_y + region.height)); y++) {
+        for(size_t x = static_cast<size_t>(region.top_left_x); x < std::min(img_width, static_cast<size_t>(region.top_left_x + region.width)); x++) {
+            Color pixel = pixels.get()[x + y * img_width];
+
+            if (config.linear) {
+                color_accumulator[0] += SRGB_TO_LINEAR[pixel.red];
+                color_accumulator[1] += SRGB_TO_LINEAR[pixel.green];
+                color_accumulator[2] += SRGB_TO_LINEAR[pixel.blue];
+                pixel_count++;
+                continue;
+            }
+
+            luma_accumulator += configured_luma(config, pixel);
+
+            if (average_color != nullptr) {
+                color_accumulator[0] += pixel.red;
+                color_accumulator[1] += pixel.green;
+                color_accumulator[2] += pixel.blue;
+            }
+
+            pixel_count++;
+        }
+    }
+
+    if(config.linear) {
+        if(pixel_count == 0) {
+            return 0;
+        }
+
+        const Color mean = linear_mean(color_accumulator, static_cast<uint64_t>(pixel_count));
+        if(average_color != nullptr) {
+            *average_color = mean;
+        }
+
+        return configured_luma(config, mean);
+    }
+
+    if(average_color != nullptr && pixel_count != 0) {
+        const auto count = static_cast<uint64_t>(pixel_count);
+        *average_color = {
+            static_cast<uint8_t>((color_accumulator[0] + count / 2) / count),
+            static_cast<uint8_t>((color_accumulator[1] + count / 2) / count),
+            static_cast<uint8_t>((color_accumulator[2] + count / 2) / count),
+        };
+    }
+
+    if(pixel_count == 0) {
+        return luma_accumulator;
+    } else {
+        return luma_accumulator / pixel_count;
+    }
+}
+
+// 8 bit luma level of a pixel in 16.16 fixed point, one table per channel. The linear luma
+// modes need three loads and two adds; the perceived one is not a sum and falls back to
+// configured_luma.
+struct LumaLevels
+{
+    std::array<uint32_t, 256> red;
+    std::array<uint32_t, 256> green;
+    std::array<uint32_t, 256> blue;
+    bool tabulated;
+
+    explicit LumaLevels(const Configuration& config)
+        : tabulated(config.alt || !config.perceived)
+    {
+        const double red_weight = config.alt ? RED_WEIGHT_PERC : RED_WEIGHT;
+        const double green_weight = config.alt ? GREEN_WEIGHT_PERC : GREEN_WEIGHT;
+        const double blue_weight = config.alt ? BLUE_WEIGHT_PERC : BLUE_WEIGHT;
+
+        for (size_t i = 0; i < 256; i++) {
+            red[i] = static_cast<uint32_t>(std::lround(red_weight * static_cast<double>(i) * 65536));
+            green[i] = static_cast<uint32_t>(std::lround(green_weight * static_cast<double>(i) * 65536));
+            blue[i] = static_cast<uint32_t>(std::lround(blue_weight * static_cast<double>(i) * 65536));
+        }
+    }
+
+    uint8_t operator()(const Configuration& config, const Color& pixel) const
+    {
+        if (tabulated) {
+            return static_cast<uint8_t>(std::min<uint32_t>(255, (red[pixel.red] + green[pixel.green] + blue[pixel.blue] + 32768) >> 16));
+        }
+
+        return static_cast<uint8_t>(std::lround(configured_luma(config, pixel) * LUMA_MAX));
+    }
+};
+
+// Cell luma (and `average_color`) from the nested jittered samples of level config.quality
+// (at most a 2^quality square grid, see progressive.hpp) instead of every pixel, so the work
+// per cell is bounded whatever the image size.
+static double sampled_luma(const Configuration& config, const std::unique_ptr<Color[]>& pixels, const Quad& region, size_t img_width, size_t img_height, LumaRanker& ranker, const LumaLevels& levels, Color* average_color)
+{
+    const SampleRegion cell {
+        static_cast<size_t>(region.top_left_x),
+        static_cast<size_t>(region.top_left_y),
+        std::min(img_width, static_cast<size_t>(region.top_left_x + region.width)),
+        std::min(img_height, static_cast<size_t>(region.top_left_y + region.height)),
+    };
+
+    if(cell.right <= cell.left || cell.bottom <= cell.top) {
+        return 0;
+    }
+
+    double luma_accumulator = 0;
+    uint64_t color_accumulator[3] { };
+    uint64_t count = 0;
+
+    for(uint32_t level = 0; level <= config.quality; level++) {
+        visit_new_samples(cell, level, img_width, [&](size_t offset) {
+            const Color& pixel = pixels.get()[offset];
+            count++;
+
+            if(config.linear) {
+                color_accumulator[0] += SRGB_TO_LINEAR[pixel.red];
+                color_accumulator[1] += SRGB_TO_LINEAR[pixel.green];
+                color_accumulator[2] += SRGB_TO_LINEAR[pixel.blue];
+            } else {
+                luma_accumulator += configured_luma(config, pixel);
+                color_accumulator[0] += pixel.red;
+                color_accumulator[1] += pixel.green;
+                color_accumulator[2] += pixel.blue;
+            }
+
+            if(config.reducer != CellReducer::MEAN) {
+                ranker.add(levels(config, pixel));
+            }
+        });
+    }
+
+    const Color mean = config.linear ? linear_mean(color_accumulator, count)
+        : Color {
+              static_cast<uint8_t>((color_accumulator[0] + count / 2) / count),
+              static_cast<uint8_t>((color_accumulator[1] + count / 2) / count),
+              static_cast<uint8_t>((color_accumulator[2] + count / 2) / count),
+          };
+
+    if(average_color != nullptr) {
+        *average_color = mean;
+    }
+
+    if(config.reducer != CellReducer::MEAN) {
+        return ranker.take();
+    }
+
+    return config.linear ? configured_luma(config, mean) : luma_accumulator / static_cast<double>(count);
+}
+
+// Cell luma under the configured reducer. Rank reducers quantize each pixel's luma to 8 bits;
+// the mean (and `average_color`, if given) goes through average_luma as before. With --quality
+// both only see the sampled pixels.
+static double reduce_luma(const Configuration& config, const std::unique_ptr<Color[]>& pixels, const Quad& region, size_t img_width, size_t img_height, LumaRanker& ranker, const LumaLevels& levels, Color* average_color = nullptr)
+{
+    if(config.quality != 0) {
+        return sampled_luma(config, pixels, region, img_width, img_height, ranker, levels, average_color);
+    }
+
+    if(config.reducer == CellReducer::MEAN) {
+        return average_luma(config, pixels, region, img_width, img_height, average_color);
+    }
+
+    if(average_color != nullptr) {
+        average_luma(config, pixels, region, img_width, img_height, average_color);
+    }
+
+    for(size_t y = static_cast<size_t>(region.top_left_y); y < std::min(img_height, static_cast<size_t>(region.top_left_y + region.height)); y++) {
+        const Color* row = pixels.get() + y * img_width;
+        for(size_t x = static_cast<size_t>(region.top_left_x); x < std::min(img_width, static_cast<size_t>(region.top_left_x + region.width)); x++) {
+            ranker.add(levels(config, row[x]));
+        }
+    }
+
+    return ranker.take();
+}
+
+// Ink level (0-1) of each sub-cell of `region` on a grid_cols x grid_rows grid, row major.
+// Sub-cells always take at least one pixel so cells smaller than the grid are still sampled.
+template<typename T>
+static void sample_grid(const Configuration& config, const std::unique_ptr<Color[]>& pixels, const Quad& region, size_t img_width, size_t img_height, size_t grid_cols, size_t grid_rows, T* ink)
+{
+    const double sub_width = region.width / static_cast<double>(grid_cols);
+    const double sub_height = region.height / static_cast<double>(grid_rows);
+
+    for (size_t sub_y = 0; sub_y < grid_rows; sub_y++) {
+        for (size_t sub_x = 0; sub_x < grid_cols; sub_x++) {
+            Quad sub_quad {
+                region.top_left_x + static_cast<double>(sub_x) * sub_width,
+                region.top_left_y + static_cast<double>(sub_y) * sub_height,
+                std::max(sub_width, 1.0),
+                std::max(sub_height, 1.0),
+            };
+
+            const double luminance = average_luma(config, pixels, sub_quad, img_width, img_height);
+            ink[sub_y * grid_cols + sub_x] = static_cast<T>(config.inverted ? 1 - luminance : luminance);
+        }
+    }
+}
+
+static std::array<double, SHAPE_SAMPLES> sample_shape(const Configuration& config, const std::unique_ptr<Color[]>& pixels, const Quad& region, size_t img_width, size_t img_height)
+{
+    std::array<double, SHAPE_SAMPLES> ink { };
+    sample_grid(config, pixels, region, img_width, img_height, SHAPE_COLS, SHAPE_ROWS, ink.data());
+    return ink;
+}
+
+void normalize_dimensions(Configuration& config, size_t width, size_t height)
+{
+    if(config.cols == -1U && config.rows == -1U) {
+        config.cols = static_cast<uint32_t>(width);
+        config.rows = static_cast<uint32_t>(height);
+    } else if(config.cols == -1U) {
+        double cols = static_cast<double>(config.rows) * static_cast<double>(width) / static_cast<double>(height);
+        config.cols = static_cast<uint32_t>(cols + 1); //Use Ceiling to cover leftover image
+    } else if(config.rows == -1U) {
+        double rows = static_cast<double>(config.cols) * static_cast<double>(height) / static_cast<double>(width);
+        config.rows = static_cast<uint32_t>(rows + 1); //Use Ceiling to cover leftover image
+    }
+}
+
+bool progressive_supported(const Configuration& config)
+{
+    return !config.shapes && !config.edges && config.unicode_mode == UnicodeMode::NONE && config.sharpen <= 0 && config.filter == ResampleFilter::BOX
+        && config.contrast_mode == ContrastMode::NONE && config.reducer == CellReducer::MEAN;
+}
+
+bool progressive_refines(const Configuration& config)
+{
+    return config.progressive && config.output_path.empty() && progressive_supported(config);
+}
+
+bool plane_supported(const Configuration& config, size_t img_width, size_t img_height)
+{
+    const double quad_width = static_cast<double>(img_width) / static_cast<double>(config.cols);
+    const double quad_height = static_cast<double>(img_height) / (static_cast<double>(config.rows) * config.font_ratio);
+
+    return progressive_supported(config) && config.quality == 0 && !progressive_refines(config) && !upscaling(quad_width, quad_height);
+}
+
+CellSpans cell_spans(size_t extent, double quad_size)
+{
+    CellSpans spans;
+
+    for (double start = 0; start < static_cast<double>(extent); start += quad_size) {
+        if (quad_size < 1) {
+            const size_t centre = std::min(extent - 1, static_cast<size_t>(start + quad_size / 2));
+            spans.begin.push_back(centre);
+            spans.end.push_back(centre + 1);
+            continue;
+        }
+
+        spans.begin.push_back(static_cast<size_t>(start));
+        spans.end.push_back(std::min(extent, static_cast<size_t>(start + quad_size)));
+    }
+
+    return spans;
+}
+
+void cell_means(const CellSpans& columns, const float* column_sums, size_t height, float* means)
+{
+    for(size_t c = 0; c < columns.size(); c++) {
+        double sum = 0;
+        for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+            sum += static_cast<double>(column_sums[x]);
+        }
+
+        means[c] = static_cast<float>(sum / static_cast<double>((columns.end[c] - columns.begin[c]) * height));
+    }
+}
+
+// The whole pixels of cell (col, row), the region the averaging passes read.
+static Quad span_quad(const CellSpans& columns, const CellSpans& rows, size_t col, size_t row)
+{
+    return {
+        static_cast<double>(columns.begin[col]),
+        static_cast<double>(rows.begin[row]),
+        static_cast<double>(columns.end[col] - columns.begin[col]),
+        static_cast<double>(rows.end[row] - rows.begin[row]),
+    };
+}
+
+// Mean luma of every cell, row major, with their histogram gathered in the same pass. Rows of
+// cells are split across threads, each filling its own histogram, and the histograms are
+// summed once every thread is done.
+static std::vector<float> cell_luminance(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& columns, const CellSpans& rows, LumaHistogram& histogram)
+{
+    std::vector<float> luminance(columns.size() * rows.size());
+
+    const size_t cores = config.max_threads != 0 ? config.max_threads : std::thread::hardware_concurrency();
+    const size_t workers = std::clamp<size_t>(cores, 1, std::max<size_t>(1, rows.size()));
+    std::vector<LumaHistogram> histograms(workers, LumaHistogram { });
+
+    const auto work = [&](size_t worker) {
+        trace_thread_name("histogram worker");
+        TraceScope scope("cell luminance", "worker", static_cast<int64_t>(worker));
+
+        LumaHistogram& local = histograms[worker];
+        LumaRanker ranker(config);
+        const LumaLevels levels(config);
+        for(size_t row = worker * rows.size() / workers; row < (worker + 1) * rows.size() / workers; row++) {
+            for(size_t col = 0; col < columns.size(); col++) {
+                const double value = reduce_luma(config, pixels, span_quad(columns, rows, col, row), img_width, img_height, ranker, levels);
+                luminance[row * columns.size() + col] = static_cast<float>(value);
+                local[histogram_bin(value)]++;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t worker = 1; worker < workers; worker++) {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+
+    histogram.fill(0);
+    for(const LumaHistogram& local : histograms) {
+        for(size_t bin = 0; bin < HISTOGRAM_BINS; bin++) {
+            histogram[bin] += local[bin];
+        }
+    }
+
+    return luminance;
+}
+
+void doAsciiConversion(const Configuration& config, std::string& out, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, ProgressiveSampler* sampler, const uint8_t* visible) {
+    out.reserve(out.size() + (static_cast<size_t>(config.cols) + 2) * (static_cast<size_t>(config.rows) + 1));
+
+    double quad_width = static_cast<double>(img_width) / static_cast<double>(config.cols);
+    double quad_height = static_cast<double>(img_height) / (static_cast<double>(config.rows) * config.font_ratio);
+
+    if (config.unicode_mode == UnicodeMode::HALF_BLOCKS) {
+        half_block_conversion(config, out, pixels.get(), visible, img_width, img_height, quad_width, quad_height);
+        return;
+    }
+
+    const bool colored = config.color_mode != ColorMode::NONE;
+    if (colored) {
+        // Worst case every cell carries its own truecolor escape.
+        out.reserve(out.size() + static_cast<size_t>(config.cols) * static_cast<size_t>(config.rows) * 20);
+    }
+
+    const bool unicode = config.unicode_mode != UnicodeMode::NONE;
+    if (unicode) {
+        // Braille and block elements are 3 bytes of UTF-8 each.
+        out.reserve(out.size() + static_cast<size_t>(config.cols) * static_cast<size_t>(config.rows) * 2);
+    }
+
+    ForegroundWriter foreground(config.color_mode, config.color_tolerance);
+
+    const CellSpans columns = cell_spans(img_width, quad_width);
+    const CellSpans rows = cell_spans(img_height, quad_height);
+    const std::vector<uint8_t> blank = visible != nullptr ? blank_cells(visible, img_width, columns, rows) : std::vector<uint8_t> { };
+
+    ShapeMatcher shapes;
+
+    const size_t levels = DENSITY.size() + config.num_spaces;
+
+    // Sharpening, resampling filters and the contrast modes produce every cell's luma before
+    // the first glyph is picked.
+    std::vector<float> cell_lumas;
+    std::unique_ptr<ContrastMap> contrast;
+    size_t cell_luma_cols = 0;
+    const bool whole_image = config.sharpen > 0 || config.filter != ResampleFilter::BOX || config.contrast_mode != ContrastMode::NONE;
+    if (whole_image && !config.shapes && !unicode) {
+        LumaHistogram histogram;
+
+        if (config.sharpen > 0 || config.filter != ResampleFilter::BOX) {
+            cell_lumas = config.sharpen > 0 ? sharpened_cells(config, pixels, img_width, img_height, columns, rows)
+                : resampled_cells(config, pixels, img_width, img_height, quad_width, quad_height);
+            histogram.fill(0);
+            for (float value : cell_lumas) {
+                histogram[histogram_bin(static_cast<double>(value))]++;
+            }
+        } else {
+            cell_lumas = cell_luminance(config, pixels, img_width, img_height, columns, rows, histogram);
+        }
+
+        if (config.contrast_mode != ContrastMode::NONE) {
+            contrast = std::make_unique<ContrastMap>(config, cell_lumas, histogram, columns.size(), rows.size());
+        }
+        cell_luma_cols = columns.size();
+    }
+
+    // Cells smaller than a pixel are filled in from a grid holding each pixel's luma once.
+    std::unique_ptr<UpscaledCells> upscaled;
+    if (upscaling(quad_width, quad_height) && !config.shapes && !unicode && cell_lumas.empty() && config.reducer == CellReducer::MEAN) {
+        upscaled = std::make_unique<UpscaledCells>(config, pixels, img_width, img_height, columns, rows, quad_width, quad_height);
+    }
+
+    // A progressive render keeps its samples in `sampler` and only reads what this level adds.
+    if (sampler != nullptr && (config.quality == 0 || !progressive_supported(config) || upscaled)) {
+        sampler = nullptr;
+    }
+
+    if (sampler != nullptr) {
+        sampler->refine(config, pixels.get(), img_width, columns, rows, config.quality);
+    }
+
+    // Plain mean cells are gathered a character row at a time in memory order. Edge glyphs
+    // only replace the density glyph, so cells without one match a run without -e; the edge
+    // pass advances `cell_rows` itself and hands back each cell's mean.
+    std::unique_ptr<CellRowAccumulator> cell_rows;
+    if (!config.shapes && !unicode && cell_lumas.empty() && config.reducer == CellReducer::MEAN && config.quality == 0 && !upscaled) {
+        cell_rows = std::make_unique<CellRowAccumulator>(config, pixels, img_width, columns, rows, colored);
+    }
+
+    std::vector<EdgeCell> edges;
+    size_t edge_cols = 0;
+    if (config.edges && !config.shapes && !unicode) {
+        edges = edge_cells(config, pixels, img_width, img_height, columns, rows, cell_rows.get());
+        edge_cols = columns.size();
+    }
+
+    LumaRanker ranker(config);
+    const LumaLevels luma_levels(config);
+    const ToneCurve tone(config, levels);
+    Ditherer ditherer(config.dither_mode, columns.size());
+
+    const size_t grid_cols = unicode_grid_cols(config.unicode_mode);
+    const size_t grid_rows = unicode_grid_rows(config.unicode_mode);
+    const auto dot_threshold = static_cast<float>(config.dot_threshold);
+    std::array<float, 8> dots { };
+
+    int64_t row = 0;
+    for (double y = 0; y < static_cast<double>(img_height); y += quad_height, row++) {
+        TraceScope band("convert band", "row", row);
+
+        if (cell_rows && edges.empty()) {
+            cell_rows->next();
+        }
+
+        size_t col = 0;
+        for (double x = 0; x < static_cast<double>(img_width); x += quad_width, col++) {
+            if (!blank.empty() && blank[static_cast<size_t>(row) * columns.size() + col] != 0) {
+                out += ' ';
+                continue;
+            }
+
+            // Shapes and dots subdivide the exact cell; averages read the pixels of its span.
+            Quad char_quad { x, y, quad_width, quad_height };
+            const Quad cell_quad = span_quad(columns, rows, col, static_cast<size_t>(row));
+            Color color { };
+            char glyph;
+
+            if (unicode) {
+                if (colored) {
+                    average_luma(config, pixels, cell_quad, img_width, img_height, &color);
+                }
+
+                sample_grid(config, pixels, char_quad, img_width, img_height, grid_cols, grid_rows, dots.data());
+                const std::string_view cell = unicode_glyph(config.unicode_mode, unicode_mask(config.unicode_mode, dots.data(), dot_threshold));
+
+                if (colored) {
+                    foreground.write(out, color, cell);
+                } else {
+                    out += cell;
+                }
+
+                continue;
+            } else if (config.shapes) {
+                if (colored) {
+                    average_luma(config, pixels, cell_quad, img_width, img_height, &color);
+                }
+
+                glyph = shapes.match(sample_shape(config, pixels, char_quad, img_width, img_height));
+            } else {
+                const size_t cell = static_cast<size_t>(row) * edge_cols + col;
+                const EdgeCell* edge = cell < edges.size() ? &edges[cell] : nullptr;
+
+                double luminance;
+                if (!cell_lumas.empty()) {
+                    if (colored) {
+                        average_luma(config, pixels, cell_quad, img_width, img_height, &color);
+                    }
+
+                    luminance = static_cast<double>(cell_lumas[static_cast<size_t>(row) * cell_luma_cols + col]);
+                    if (contrast) {
+                        luminance = contrast->apply(luminance, static_cast<size_t>(row), col);
+                    }
+                } else if (upscaled) {
+                    luminance = upscaled->luminance(static_cast<size_t>(row), col);
+                    color = upscaled->color(static_cast<size_t>(row), col);
+                } else if (sampler != nullptr) {
+                    luminance = sampler->luminance(static_cast<size_t>(row), col);
+                    color = sampler->color(static_cast<size_t>(row), col);
+                } else if (cell_rows && edge != nullptr) {
+                    luminance = edge->luminance;
+                    color = edge->color;
+                } else if (cell_rows) {
+                    luminance = cell_rows->luminance()[col];
+                    color = cell_rows->colors()[col];
+                } else {
+                    luminance = reduce_luma(config, pixels, cell_quad, img_width, img_height, ranker, luma_levels, colored ? &color : nullptr);
+                }
+
+                const size_t index = ditherer.quantize(tone.level(luminance), levels, static_cast<size_t>(row), col);
+
+                glyph = index >= DENSITY.size() ? ' ' : DENSITY[index];
+
+                if (edge != nullptr && edge->glyph != '\0') {
+                    glyph = edge->glyph;
+                }
+            }
+
+            if (colored) {
+                foreground.write(out, color, glyph);
+            } else {
+                out += glyph;
+            }
+        }
+
+        if (colored && config.redraw_lines) {
+            foreground.finish(out);
+        }
+
+        out += '\n';
+    }
+
+    foreground.finish(out);
+}
+
+// Plain mean cells of a grey or RGBA plane, gathered by CellRowAccumulator.
+static void plane_conversion(const Configuration& config, std::string& out, const uint8_t* plane, size_t channels, size_t img_width, size_t img_height)
+{
+    out.reserve(out.size() + (static_cast<size_t>(config.cols) + 2) * (static_cast<size_t>(config.rows) + 1));
+
+    const double quad_width = static_cast<double>(img_width) / static_cast<double>(config.cols);
+    const double quad_height = static_cast<double>(img_height) / (static_cast<double>(config.rows) * config.font_ratio);
+
+    const bool colored = config.color_mode != ColorMode::NONE;
+    if (colored) {
+        out.reserve(out.size() + static_cast<size_t>(config.cols) * static_cast<size_t>(config.rows) * 20);
+    }
+
+    const CellSpans columns = cell_spans(img_width, quad_width);
+    const CellSpans rows = cell_spans(img_height, quad_height);
+
+    const size_t levels = DENSITY.size() + config.num_spaces;
+    const ToneCurve tone(config, levels);
+    Ditherer ditherer(config.dither_mode, columns.size());
+    ForegroundWriter foreground(config.color_mode, config.color_tolerance);
+    CellRowAccumulator cell_rows(config, plane, channels, img_width, columns, rows);
+
+    for (size_t row = 0; cell_rows.next(); row++) {
+        TraceScope band("convert band", "row", static_cast<int64_t>(row));
+        const std::vector<uint8_t>& transparent = cell_rows.transparent();
+
+        for (size_t col = 0; col < columns.size(); col++) {
+            if (!transparent.empty() && transparent[col] != 0) {
+                out += ' ';
+                continue;
+            }
+
+            const size_t index = ditherer.quantize(tone.level(cell_rows.luminance()[col]), levels, row, col);
+            const char glyph = index >= DENSITY.size() ? ' ' : DENSITY[index];
+
+            if (colored) {
+                foreground.write(out, cell_rows.colors()[col], glyph);
+            } else {
+                out += glyph;
+            }
+        }
+
+        if (colored && config.redraw_lines) {
+            foreground.finish(out);
+        }
+
+        out += '\n';
+    }
+
+    foreground.finish(out);
+}
+
+void doGrayConversion(const Configuration& config, std::string& out, const uint8_t* gray, size_t img_width, size_t img_height)
+{
+    plane_conversion(config, out, gray, 1, img_width, img_height);
+}
+
+void doRgbaConversion(const Configuration& config, std::string& out, const uint8_t* rgba, size_t img_width, size_t img_height)
+{
+    plane_conversion(config, out, rgba, 4, img_width, img_height);
+}
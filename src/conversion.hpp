@@ -0,0 +1,228 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static constexpr std::string_view DENSITY{ "@QB#NgWM8RDHdOKq9$6khEPXwmeZaoS2yjufF]}{tx1zv7lciL/\\|?*>r^;:_\"~,'.-`" };
+
+struct Color
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+};
+
+struct Quad
+{
+    double top_left_x;
+    double top_left_y;
+    double width;
+    double height;
+};
+
+enum class ColorMode
+{
+    NONE,
+    TRUECOLOR,
+    XTERM_256,
+};
+
+// How cells are sampled from the image. BOX averages the whole pixels a cell covers.
+enum class ResampleFilter
+{
+    BOX,
+    AREA,
+    BILINEAR,
+    GAUSSIAN,
+    LANCZOS,
+};
+
+// How cells smaller than a pixel are filled in from the pixels around them.
+enum class UpscaleFilter
+{
+    NEAREST,
+    BILINEAR,
+};
+
+// Curve taking 16 bit and HDR sources from linear light to the 0-1 range. AUTO is REINHARD
+// for HDR (float) sources and CLAMP for 16 bit ones.
+enum class ToneMap
+{
+    AUTO,
+    CLAMP,
+    REINHARD,
+    FILMIC,
+};
+
+// How a cell's pixel lumas are reduced to one value.
+enum class CellReducer
+{
+    MEAN,
+    MIN,
+    MAX,
+    MEDIAN,
+    PERCENTILE,
+};
+
+enum class DitherMode
+{
+    NONE,
+    FLOYD_STEINBERG,
+    ATKINSON,
+    BAYER,
+    NOISE,
+};
+
+enum class ContrastMode
+{
+    NONE,
+    STRETCH,
+    EQUALIZE,
+    CLAHE,
+};
+
+// Sub-cell block glyphs drawn instead of ASCII, see unicode.hpp.
+enum class UnicodeMode
+{
+    NONE,
+    BRAILLE,
+    QUADRANTS,
+    HALF_BLOCKS,
+};
+
+struct Configuration
+{
+    bool print_usage = false;
+    bool inverted = false;
+    bool perceived = false;
+    bool alt = false;
+    bool linear = false;
+    bool perf_counters = false;
+    bool bench = false;
+    bool bench_palette = false;
+
+    uint32_t cols = -1U;
+    uint32_t rows = -1U;
+
+    double font_ratio = 0.5;
+
+    size_t num_spaces = 9;
+
+    bool edges = false;
+    bool shapes = false;
+    double edge_threshold = 0.2;
+
+    double sharpen = 0;
+    size_t sharpen_radius = 0;
+
+    double contrast = 1;
+    double brightness = 0;
+    double gamma = 1;
+
+    ToneMap tone_map = ToneMap::AUTO;
+    double exposure = 0;
+
+    // Transparent pixels are composited over `background`, or left out of their cell's mean
+    // with `alpha_weighted`.
+    Color background { 0, 0, 0 };
+    bool alpha_weighted = false;
+
+    ResampleFilter filter = ResampleFilter::BOX;
+    UpscaleFilter upscale = UpscaleFilter::NEAREST;
+    CellReducer reducer = CellReducer::MEAN;
+    double percentile = 50;
+
+    // Cells read a jittered 2^quality square grid of pixels instead of every pixel; 0 reads all.
+    uint32_t quality = 0;
+    bool progressive = false;
+
+    // Every output line sets its own colours, for output redrawn a line at a time
+    // (--progressive, animation playback).
+    bool redraw_lines = false;
+
+    // Most threads one conversion may run on, 0 for one per core. Callers that already convert
+    // in parallel (the GIF frame pool) hand each conversion its share.
+    size_t max_threads = 0;
+
+    DitherMode dither_mode = DitherMode::NONE;
+
+    ContrastMode contrast_mode = ContrastMode::NONE;
+    double clahe_limit = 2.5;
+
+    UnicodeMode unicode_mode = UnicodeMode::NONE;
+    double dot_threshold = 0.5;
+
+    ColorMode color_mode = ColorMode::NONE;
+    uint8_t color_tolerance = 0;
+
+    std::string_view input_path { };
+    std::string_view output_path { };
+    std::string_view trace_path { };
+    std::string_view bench_baseline { };
+};
+
+// Pixel span [begin, end) covered by each cell along one axis, stepping exactly like the
+// quad loop in doAsciiConversion so passes working per row see the same cells. Cells smaller
+// than a pixel take the pixel under their centre, as UpscaledCells does, so none is empty.
+struct CellSpans
+{
+    std::vector<size_t> begin;
+    std::vector<size_t> end;
+
+    size_t size() const { return begin.size(); }
+
+    // Whether span i covers the same pixels as the one before it, as cells smaller than a pixel can.
+    bool repeats(size_t i) const { return i > 0 && begin[i] == begin[i - 1] && end[i] == end[i - 1]; }
+};
+
+CellSpans cell_spans(size_t extent, double quad_size);
+
+// Mean of every cell of one row of cells, from per pixel column sums over its `height` pixel
+// rows, for passes that stream the image a row at a time (edge_cells, sharpened_cells).
+void cell_means(const CellSpans& columns, const float* column_sums, size_t height, float* means);
+
+// Fills in whichever of cols / rows was not given from the image aspect ratio.
+void normalize_dimensions(Configuration& config, size_t width, size_t height);
+
+// Whether the configuration takes plain mean cells, the only ones --progressive refines.
+bool progressive_supported(const Configuration& config);
+
+// Whether --progressive actually prints coarse renders: only to a terminal, for supported modes.
+bool progressive_refines(const Configuration& config);
+
+// Whether a grayscale or RGBA source can be rendered in its own layout by doGrayConversion /
+// doRgbaConversion: plain mean cells of at least a pixel, which is all that reads it directly.
+bool plane_supported(const Configuration& config, size_t img_width, size_t img_height);
+
+class ProgressiveSampler;
+
+// `sampler`, when given, carries --quality samples over from an earlier render of the same image.
+// `visible`, when given, marks the pixels of a flattened RGBA image that were not fully
+// transparent (see flatten_alpha); cells without one come out blank.
+void doAsciiConversion(const Configuration& config, std::string& out, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, ProgressiveSampler* sampler = nullptr, const uint8_t* visible = nullptr);
+
+// doAsciiConversion for a one byte per pixel grayscale image, see plane_supported.
+void doGrayConversion(const Configuration& config, std::string& out, const uint8_t* gray, size_t img_width, size_t img_height);
+
+// doAsciiConversion for a four byte per pixel RGBA image, see plane_supported. Cells without
+// a visible pixel come out blank.
+void doRgbaConversion(const Configuration& config, std::string& out, const uint8_t* rgba, size_t img_width, size_t img_height);
@@ -0,0 +1,119 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "dither.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr size_t BAYER_SIZE = 8;
+
+// Recursive Bayer construction: M(2n) = [4M, 4M + 2; 4M + 3, 4M + 1].
+static constexpr std::array<std::array<float, BAYER_SIZE>, BAYER_SIZE> BAYER = [] {
+    std::array<std::array<unsigned, BAYER_SIZE>, BAYER_SIZE> order { };
+
+    for(size_t size = 1; size < BAYER_SIZE; size *= 2) {
+        for(size_t y = 0; y < size; y++) {
+            for(size_t x = 0; x < size; x++) {
+                const unsigned base = 4 * order[y][x];
+                order[y][x] = base;
+                order[y][x + size] = base + 2;
+                order[y + size][x] = base + 3;
+                order[y + size][x + size] = base + 1;
+            }
+        }
+    }
+
+    // Centre every threshold in its interval, offsets in (-0.5, 0.5).
+    std::array<std::array<float, BAYER_SIZE>, BAYER_SIZE> thresholds { };
+    for(size_t y = 0; y < BAYER_SIZE; y++) {
+        for(size_t x = 0; x < BAYER_SIZE; x++) {
+            thresholds[y][x] = (static_cast<float>(order[y][x]) + 0.5f) / (BAYER_SIZE * BAYER_SIZE) - 0.5f;
+        }
+    }
+
+    return thresholds;
+}();
+
+// Interleaved gradient noise (Jimenez 2014): a cheap closed form whose spectrum is close
+// enough to blue noise to hide the cross-hatch Bayer leaves on flat areas.
+static float gradient_noise(size_t row, size_t col)
+{
+    const double x = static_cast<double>(col);
+    const double y = static_cast<double>(row);
+    const double inner = 0.06711056 * x + 0.00583715 * y;
+    const double outer = 52.9829189 * (inner - std::floor(inner));
+
+    return static_cast<float>(outer - std::floor(outer)) - 0.5f;
+}
+
+Ditherer::Ditherer(DitherMode dither_mode, size_t columns)
+    : mode(dither_mode)
+{
+    if(mode == DitherMode::FLOYD_STEINBERG || mode == DitherMode::ATKINSON) {
+        for(auto& row : errors) {
+            row.assign(columns + 2 * PADDING, 0);
+        }
+    }
+}
+
+size_t Ditherer::quantize(double level, size_t levels, size_t row, size_t col)
+{
+    const auto clamp_index = [&](double value) {
+        return static_cast<size_t>(std::clamp(value, 0.0, static_cast<double>(levels - 1)));
+    };
+
+    switch(mode) {
+        case DitherMode::NONE: return clamp_index(level);
+        case DitherMode::BAYER: return clamp_index(level + 0.5 + static_cast<double>(BAYER[row % BAYER_SIZE][col % BAYER_SIZE]));
+        case DitherMode::NOISE: return clamp_index(level + 0.5 + static_cast<double>(gradient_noise(row, col)));
+        default: break;
+    }
+
+    while(current_row < row) {
+        std::fill(errors[current].begin(), errors[current].end(), 0.0f);
+        current = (current + 1) % ERROR_ROWS;
+        current_row++;
+    }
+
+    const size_t at = col + PADDING;
+    const double wanted = level + static_cast<double>(error(0, at));
+    const size_t index = clamp_index(wanted);
+    // Index i stands for [i, i + 1) on the ramp, so for its middle, except the last which is
+    // only reached at levels - 1 itself. Error past what the end glyphs show is dropped: a flat
+    // saturated area would otherwise push it on, growing, into whatever comes after it.
+    const double top = static_cast<double>(levels - 1);
+    const double shown = std::min(static_cast<double>(index) + 0.5, top);
+    const auto residual = static_cast<float>(std::clamp(wanted, std::min(0.5, top), top) - shown);
+
+    if(mode == DitherMode::FLOYD_STEINBERG) {
+        error(0, at + 1) += residual * (7.0f / 16);
+        error(1, at - 1) += residual * (3.0f / 16);
+        error(1, at) += residual * (5.0f / 16);
+        error(1, at + 1) += residual * (1.0f / 16);
+    } else {
+        // Atkinson only passes on 6/8 of the error, which keeps highlights and shadows clean.
+        const float share = residual / 8;
+        error(0, at + 1) += share;
+        error(0, at + 2) += share;
+        error(1, at - 1) += share;
+        error(1, at) += share;
+        error(1, at + 1) += share;
+        error(2, at) += share;
+    }
+
+    return index;
+}
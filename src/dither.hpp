@@ -0,0 +1,50 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Spreads the quantization error of the density ramp so gradients do not band. Works on the
+// cell grid as the glyph index is picked, so no extra pass over the pixels is needed.
+//
+// Error diffusion (Floyd-Steinberg, Atkinson) keeps a ring of the rows the kernel reaches
+// below the current one (two and three rows), and cells must be visited row by row, left to
+// right. Ordered modes (Bayer, noise) only depend on the cell position.
+class Ditherer
+{
+public:
+    Ditherer(DitherMode dither_mode, size_t columns);
+
+    // Glyph index in [0, levels) for `level`, a position on the ramp in [0, levels - 1].
+    size_t quantize(double level, size_t levels, size_t row, size_t col);
+
+private:
+    static constexpr size_t PADDING = 2;
+    static constexpr size_t ERROR_ROWS = 3;
+
+    // `at` is the padded index, column + PADDING, so the kernel's left reach stays in range.
+    float& error(size_t ahead, size_t at) { return errors[(current + ahead) % ERROR_ROWS][at]; }
+
+    DitherMode mode;
+    size_t current_row = 0;
+    size_t current = 0;
+    std::array<std::vector<float>, ERROR_ROWS> errors;
+};
@@ -0,0 +1,407 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "edges.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "luma.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+// Below this the gradients in a cell point too many ways for one line to describe it.
+static constexpr double MIN_COHERENCE = 0.6;
+
+// A horizontal edge whose energy sits this far down the cell is drawn as '_' rather than '-'.
+static constexpr double UNDERSCORE_CENTROID = 0.65;
+
+struct LumaWeights
+{
+    float red;
+    float green;
+    float blue;
+};
+
+static constexpr LumaWeights WEIGHTS { 0.2126f / 255.0f, 0.7152f / 255.0f, 0.0722f / 255.0f };
+static constexpr LumaWeights WEIGHTS_PERC { 0.299f / 255.0f, 0.587f / 255.0f, 0.114f / 255.0f };
+
+struct CellAccumulator
+{
+    double xx = 0;
+    double yy = 0;
+    double xy = 0;
+    double abs_x = 0;
+    double abs_y = 0;
+    double abs_y_offset = 0;
+};
+
+// Per pixel column sums over the rows of the current cell row.
+struct ColumnSums
+{
+    std::vector<float> xx;
+    std::vector<float> yy;
+    std::vector<float> xy;
+    std::vector<float> abs_x;
+    std::vector<float> abs_y;
+    std::vector<float> abs_y_running;
+
+    explicit ColumnSums(size_t width)
+        : xx(width), yy(width), xy(width), abs_x(width), abs_y(width), abs_y_running(width)
+    {
+    }
+};
+
+void load_luma(const Configuration& config, const Color* row, size_t width, float* luma)
+{
+    const auto* bytes = reinterpret_cast<const uint8_t*>(row);
+    const bool perceived = config.perceived && !config.alt;
+    const LumaWeights& weights = config.alt || config.perceived ? WEIGHTS_PERC : WEIGHTS;
+    const float root = std::sqrt(255.0f);
+
+    // Linear light channels scaled back to 0-255, so the same weights apply. There is no
+    // vector table lookup, so this runs a pixel at a time.
+    if(config.linear) {
+        const float scale = 255.0f / 65535.0f;
+        for(size_t x = 0; x < width; x++) {
+            const float red = static_cast<float>(SRGB_TO_LINEAR[bytes[3 * x]]) * scale;
+            const float green = static_cast<float>(SRGB_TO_LINEAR[bytes[3 * x + 1]]) * scale;
+            const float blue = static_cast<float>(SRGB_TO_LINEAR[bytes[3 * x + 2]]) * scale;
+
+            if(perceived) {
+                luma[x] = std::sqrt(weights.red * red * red + weights.green * green * green + weights.blue * blue * blue) / root;
+            } else {
+                luma[x] = weights.red * red + weights.green * green + weights.blue * blue;
+            }
+        }
+        return;
+    }
+
+    // Four pixels at a time, products and sums in the same order as the scalar tail.
+    const auto pixel_luma = [&](size_t x, auto lane) {
+        using Lane = decltype(lane);
+
+        Lane red;
+        Lane green;
+        Lane blue;
+        Lane::load_rgb(bytes + 3 * x, red, green, blue);
+
+        if(perceived) {
+            const Lane squares = Lane::broadcast(weights.red) * red * red + Lane::broadcast(weights.green) * green * green + Lane::broadcast(weights.blue) * blue * blue;
+            (sqrt(squares) / Lane::broadcast(root)).store(luma + x);
+        } else {
+            (Lane::broadcast(weights.red) * red + Lane::broadcast(weights.green) * green + Lane::broadcast(weights.blue) * blue).store(luma + x);
+        }
+    };
+
+    for_each_lane(0, width, pixel_luma);
+}
+
+static char classify(const CellAccumulator& cell, double cell_width, double cell_height, double threshold)
+{
+    const double trace = cell.xx + cell.yy;
+    if(trace <= 0) {
+        return '\0';
+    }
+
+    const double spread = std::sqrt((cell.xx - cell.yy) * (cell.xx - cell.yy) + 4 * cell.xy * cell.xy);
+    if(spread < MIN_COHERENCE * trace) {
+        return '\0';
+    }
+
+    // The dominant gradient direction t (y pointing down) has cos 2t and sin 2t straight from
+    // the tensor, so the half angle formulas give |cos t| and |sin t| without any trig calls.
+    // The edge itself runs perpendicular to t.
+    const double cos_double = (cell.xx - cell.yy) / spread;
+    const double cos_gradient = std::sqrt(std::max(0.0, 0.5 * (1 + cos_double)));
+    const double sin_gradient = std::sqrt(std::max(0.0, 0.5 * (1 - cos_double)));
+
+    // sum |g| from the L1 sums, exact when every gradient shares the dominant direction.
+    const double magnitude = (cell.abs_x + cell.abs_y) / (cos_gradient + sin_gradient);
+
+    // A step of contrast c crossing the cell leaves a two pixel wide band of |g| = c, so
+    // dividing by twice the chord length through the cell recovers c. The edge runs along x
+    // by |sin t| and along y by |cos t|.
+    const double chord = std::min(sin_gradient > 1e-6 ? cell_width / sin_gradient : HUGE_VAL, cos_gradient > 1e-6 ? cell_height / cos_gradient : HUGE_VAL);
+
+    if(magnitude / (2 * chord) < threshold) {
+        return '\0';
+    }
+
+    // t within 22.5 degrees of horizontal is 2t within 45 degrees of zero, a vertical edge;
+    // within 22.5 degrees of vertical, a horizontal one. Between them the sign of sin 2t,
+    // the sign of xy, tells '/' from '\\'.
+    if(cos_double > std::numbers::sqrt2 / 2) {
+        return '|';
+    }
+
+    if(cos_double <= -std::numbers::sqrt2 / 2) {
+        return cell.abs_y_offset / cell.abs_y > UNDERSCORE_CENTROID ? '_' : '-';
+    }
+
+    return cell.xy > 0 ? '/' : '\\';
+}
+
+bool binned_cells(const CellSpans& columns, const CellSpans& rows)
+{
+    // A quarter of the pixels, and still at least four bins to a cell each way.
+    static constexpr size_t BINNED_CELL = 8;
+
+    const auto smallest = [](const CellSpans& spans) {
+        size_t size = SIZE_MAX;
+        for(size_t i = 0; i < spans.size(); i++) {
+            size = std::min(size, spans.end[i] - spans.begin[i]);
+        }
+        return size;
+    };
+
+    return smallest(columns) >= BINNED_CELL && smallest(rows) >= BINNED_CELL;
+}
+
+// Weights out of 2^14, so a bin's weighted sum stays exact in a float.
+static constexpr int16_t INTEGER_WEIGHTS[3] { 3483, 11718, 1183 };
+static constexpr int16_t INTEGER_WEIGHTS_PERC[3] { 4899, 9617, 1868 };
+
+// Bins of the channel derived modes are weighted integer channel sums, so they take one
+// multiply each. The weights are a template argument so the vectors made from them are
+// constants rather than rebuilt for every eight bins.
+template<const int16_t (&WEIGHTS)[3]>
+static void load_weighted_luma(const uint8_t* upper, const uint8_t* lower, size_t width, float* luma)
+{
+    const size_t bins = (width + 1) / 2;
+    const float scale = 1.0f / (4.0f * 255.0f * 16384.0f);
+
+    size_t j = 0;
+    for(; 2 * j + 4 * Float4::WIDTH <= width; j += 2 * Float4::WIDTH) {
+        Float4 low;
+        Float4 high;
+        Float4::load_weighted_bins(upper + 6 * j, lower + 6 * j, WEIGHTS, low, high);
+        (low * Float4::broadcast(scale)).store(luma + j);
+        (high * Float4::broadcast(scale)).store(luma + j + Float4::WIDTH);
+    }
+
+    for(; j < bins; j++) {
+        const size_t right = std::min(2 * j + 1, width - 1);
+        int32_t sum = 0;
+        for(size_t channel = 0; channel < 3; channel++) {
+            sum += (upper[6 * j + channel] + upper[3 * right + channel] + lower[6 * j + channel] + lower[3 * right + channel]) * WEIGHTS[channel];
+        }
+        luma[j] = static_cast<float>(sum) * scale;
+    }
+}
+
+void load_binned_luma(const Configuration& config, const Color* top, const Color* bottom, size_t width, float* luma, std::vector<float>& scratch)
+{
+    // Perceived and linear light luma are binned from their per pixel values.
+    if((config.perceived && !config.alt) || config.linear) {
+        const size_t bins = (width + 1) / 2;
+        scratch.resize(2 * width);
+        load_luma(config, top, width, scratch.data());
+        load_luma(config, bottom, width, scratch.data() + width);
+
+        for(size_t j = 0; j < bins; j++) {
+            const size_t right = std::min(2 * j + 1, width - 1);
+            luma[j] = 0.25f * ((scratch[2 * j] + scratch[right]) + (scratch[width + 2 * j] + scratch[width + right]));
+        }
+        return;
+    }
+
+    const auto* upper = reinterpret_cast<const uint8_t*>(top);
+    const auto* lower = reinterpret_cast<const uint8_t*>(bottom);
+    if(config.alt) {
+        load_weighted_luma<INTEGER_WEIGHTS_PERC>(upper, lower, width, luma);
+    } else {
+        load_weighted_luma<INTEGER_WEIGHTS>(upper, lower, width, luma);
+    }
+}
+
+CellSpans binned_spans(const CellSpans& spans)
+{
+    CellSpans binned;
+    for(size_t i = 0; i < spans.size(); i++) {
+        binned.begin.push_back((spans.begin[i] + 1) / 2);
+        binned.end.push_back((spans.end[i] + 1) / 2);
+    }
+    return binned;
+}
+
+// Edge cells over a luma plane of `width` x `height`, `load_row(y, out)` filling row y.
+template<typename LoadRow>
+static void plane_edge_cells(const Configuration& config, size_t width, size_t height, const CellSpans& columns, const CellSpans& rows, LoadRow&& load_row, CellRowAccumulator* cell_rows, std::vector<EdgeCell>& cells)
+{
+    // Luma rows padded with a copy of the edge value either side, so the Sobel taps at x - 1 and
+    // x + 1 need no special case. A window of the tallest cell plus the row either side holds
+    // every row a cell row reads; row y lives in slot y % window.
+    size_t tallest = 1;
+    for(size_t r = 0; r < rows.size(); r++) {
+        tallest = std::max(tallest, rows.end[r] - rows.begin[r]);
+    }
+
+    const size_t window = tallest + 2;
+    const size_t stride = width + 2;
+    std::vector<float> luma(window * stride);
+    ColumnSums column_sums(width);
+    std::vector<const float*> around(window);
+
+    size_t loaded = 0;
+    const auto load_through = [&](size_t y) {
+        for(; loaded <= std::min(y, height - 1); loaded++) {
+            float* row = luma.data() + (loaded % window) * stride;
+            load_row(loaded, row + 1);
+            row[0] = row[1];
+            row[width + 1] = row[width];
+        }
+    };
+
+    // Each lane walks down the whole cell row keeping the Sobel terms of the rows either side in
+    // registers, so every luma row is read once and the column sums written once per cell row.
+    // The gradients are left at four times their size and scaled back per cell, which is exact.
+    const auto add_cell_row = [&](size_t r) {
+        const size_t cell_height = rows.end[r] - rows.begin[r];
+        for(size_t i = 0; i < cell_height + 2; i++) {
+            const auto y = std::clamp<int64_t>(static_cast<int64_t>(rows.begin[r] + i) - 1, 0, static_cast<int64_t>(height) - 1);
+            around[i] = luma.data() + (static_cast<size_t>(y) % window) * stride;
+        }
+
+        for_each_lane(0, width, [&](size_t x, auto lane) {
+            using Lane = decltype(lane);
+
+            // diff = l[x+1] - l[x-1] and sum = l[x-1] + 2l[x] + l[x+1] of row i of `around`.
+            const auto terms = [&](size_t i, Lane& diff, Lane& sum) {
+                const Lane left = Lane::load(around[i] + x);
+                const Lane centre = Lane::load(around[i] + x + 1);
+                const Lane right = Lane::load(around[i] + x + 2);
+                diff = right - left;
+                sum = (left + right) + (centre + centre);
+            };
+
+            Lane above_diff;
+            Lane above_sum;
+            Lane diff;
+            Lane sum;
+            terms(0, above_diff, above_sum);
+            terms(1, diff, sum);
+
+            Lane xx = Lane::broadcast(0);
+            Lane yy = Lane::broadcast(0);
+            Lane xy = Lane::broadcast(0);
+            Lane abs_x = Lane::broadcast(0);
+            Lane abs_y = Lane::broadcast(0);
+            Lane abs_y_running = Lane::broadcast(0);
+
+            for(size_t i = 1; i <= cell_height; i++) {
+                Lane below_diff;
+                Lane below_sum;
+                terms(i + 1, below_diff, below_sum);
+
+                const Lane gx = (above_diff + below_diff) + (diff + diff);
+                const Lane gy = below_sum - above_sum;
+                const Lane abs_gy = abs(gy);
+
+                xx = xx + gx * gx;
+                yy = yy + gy * gy;
+                xy = xy + gx * gy;
+                abs_x = abs_x + abs(gx);
+                abs_y = abs_y + abs_gy;
+                abs_y_running = abs_y_running + abs_y;
+
+                above_diff = diff;
+                above_sum = sum;
+                diff = below_diff;
+                sum = below_sum;
+            }
+
+            xx.store(column_sums.xx.data() + x);
+            yy.store(column_sums.yy.data() + x);
+            xy.store(column_sums.xy.data() + x);
+            abs_x.store(column_sums.abs_x.data() + x);
+            abs_y.store(column_sums.abs_y.data() + x);
+            abs_y_running.store(column_sums.abs_y_running.data() + x);
+        });
+
+        for(size_t c = 0; c < columns.size(); c++) {
+            CellAccumulator cell;
+
+            double abs_y_running = 0;
+            for(size_t x = columns.begin[c]; x < columns.end[c]; x++) {
+                cell.xx += static_cast<double>(column_sums.xx[x]);
+                cell.yy += static_cast<double>(column_sums.yy[x]);
+                cell.xy += static_cast<double>(column_sums.xy[x]);
+                cell.abs_x += static_cast<double>(column_sums.abs_x[x]);
+                cell.abs_y += static_cast<double>(column_sums.abs_y[x]);
+                abs_y_running += static_cast<double>(column_sums.abs_y_running[x]);
+            }
+
+            // Row i of h (from 1) sits (i - 0.5) / h down the cell, and the running total of
+            // |gy| adds row i's in h - i + 1 times, so the offset weighted sum falls out of the two.
+            cell.abs_y_offset = ((static_cast<double>(cell_height) + 0.5) * cell.abs_y - abs_y_running) / static_cast<double>(cell_height);
+
+            cell.xx /= 16;
+            cell.yy /= 16;
+            cell.xy /= 16;
+            cell.abs_x /= 4;
+            cell.abs_y /= 4;
+            cell.abs_y_offset /= 4;
+
+            const auto cell_width = static_cast<double>(columns.end[c] - columns.begin[c]);
+            cells[r * columns.size() + c].glyph = classify(cell, cell_width, static_cast<double>(cell_height), config.edge_threshold);
+        }
+    };
+
+    for(size_t r = 0; r < rows.size(); r++) {
+        // Cells smaller than a pixel share their row with the one before.
+        if(rows.repeats(r)) {
+            std::copy_n(cells.begin() + static_cast<ptrdiff_t>((r - 1) * columns.size()), columns.size(), cells.begin() + static_cast<ptrdiff_t>(r * columns.size()));
+        } else {
+            load_through(rows.end[r]);
+            add_cell_row(r);
+        }
+
+        if(cell_rows != nullptr && cell_rows->next()) {
+            for(size_t c = 0; c < columns.size(); c++) {
+                cells[r * columns.size() + c].luminance = cell_rows->luminance()[c];
+                cells[r * columns.size() + c].color = cell_rows->colors()[c];
+            }
+        }
+    }
+}
+
+std::vector<EdgeCell> edge_cells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& columns, const CellSpans& rows, CellRowAccumulator* cell_rows)
+{
+    TraceScope scope("edges");
+
+    std::vector<EdgeCell> cells(columns.size() * rows.size(), EdgeCell { '\0', 0.0, { } });
+    if(img_width == 0 || img_height == 0) {
+        return cells;
+    }
+
+    if(binned_cells(columns, rows)) {
+        std::vector<float> scratch;
+        const auto load_row = [&](size_t y, float* out) {
+            const Color* top = pixels.get() + 2 * y * img_width;
+            const Color* bottom = pixels.get() + std::min(2 * y + 1, img_height - 1) * img_width;
+            load_binned_luma(config, top, bottom, img_width, out, scratch);
+        };
+
+        plane_edge_cells(config, (img_width + 1) / 2, (img_height + 1) / 2, binned_spans(columns), binned_spans(rows), load_row, cell_rows, cells);
+        return cells;
+    }
+
+    const auto load_row = [&](size_t y, float* out) { load_luma(config, pixels.get() + y * img_width, img_width, out); };
+    plane_edge_cells(config, img_width, img_height, columns, rows, load_row, cell_rows, cells);
+    return cells;
+}
@@ -0,0 +1,58 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "cell_rows.hpp"
+#include "conversion.hpp"
+
+struct EdgeCell
+{
+    // Line glyph ('|', '-', '_', '/', '\') when one straight edge dominates the cell, else '\0'.
+    char glyph;
+    // The cell's mean from the CellRowAccumulator passed to edge_cells, for the density ramp.
+    double luminance;
+    Color color;
+};
+
+// Luma (0-1) of one row of pixels in the configured luma mode, in linear light under -l.
+void load_luma(const Configuration& config, const Color* row, size_t width, float* luma);
+
+// Whether every cell is at least 8 pixels across and down, so a pass over the luma plane can
+// run on 2x2 bins of the image instead.
+bool binned_cells(const CellSpans& columns, const CellSpans& rows);
+
+// Luma of the 2x2 bins over rows `top` and `bottom`, bin j holding pixels 2j and 2j + 1 (2j
+// twice at an odd width's end). `scratch` is resized as needed.
+void load_binned_luma(const Configuration& config, const Color* top, const Color* bottom, size_t width, float* luma, std::vector<float>& scratch);
+
+// The bins whose first pixel lies in each span.
+CellSpans binned_spans(const CellSpans& spans);
+
+// Single pass over the image, one source row at a time: luma for each row (using the
+// configured luma mode) into a window one cell row tall plus a row either side, then Sobel
+// gradients and the per-cell structure tensor summed down each pixel column so the per pixel
+// work is element wise. Cells at least 8 pixels each way are measured on 2x2 bins of the image
+// instead, a quarter of the work, bins going to the cell holding their top left pixel. Under -l
+// the plane is linear light. A cell takes a line glyph when its gradients agree on one
+// orientation and the contrast across that edge is at least `config.edge_threshold`. The
+// glyph replaces the density glyph and nothing else: `cell_rows`, when given, is advanced
+// through each cell row right after the edge pass has read it, while its pixels are still in
+// cache, so every cell carries the same mean as a run without -e.
+std::vector<EdgeCell> edge_cells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& columns, const CellSpans& rows, CellRowAccumulator* cell_rows);
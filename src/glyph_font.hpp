@@ -0,0 +1,129 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <string_view>
+
+struct GlyphBitmap
+{
+    char glyph;
+    // 5x8 pixels, '#' is ink. Rows 0-6 sit on the baseline, row 7 holds descenders.
+    std::array<std::string_view, 8> rows;
+};
+
+static constexpr size_t GLYPH_FONT_WIDTH = 5;
+static constexpr size_t GLYPH_FONT_HEIGHT = 8;
+
+// Every printable ASCII character, in order from ' ' to '~'.
+static constexpr std::array<GlyphBitmap, 95> GLYPH_FONT { {
+    { ' ', { ".....", ".....", ".....", ".....", ".....", ".....", ".....", "....." } },
+    { '!', { "..#..", "..#..", "..#..", "..#..", "..#..", ".....", "..#..", "....." } },
+    { '"', { ".#.#.", ".#.#.", ".....", ".....", ".....", ".....", ".....", "....." } },
+    { '#', { ".#.#.", ".#.#.", "#####", ".#.#.", "#####", ".#.#.", ".#.#.", "....." } },
+    { '$', { "..#..", ".####", "#.#..", ".###.", "..#.#", "####.", "..#..", "....." } },
+    { '%', { "##...", "##..#", "...#.", "..#..", ".#...", "#..##", "...##", "....." } },
+    { '&', { ".##..", "#..#.", "#.#..", ".#...", "#.#.#", "#..#.", ".##.#", "....." } },
+    { '\'', { "..#..", "..#..", ".#...", ".....", ".....", ".....", ".....", "....." } },
+    { '(', { "...#.", "..#..", ".#...", ".#...", ".#...", "..#..", "...#.", "....." } },
+    { ')', { ".#...", "..#..", "...#.", "...#.", "...#.", "..#..", ".#...", "....." } },
+    { '*', { ".....", "..#..", "#.#.#", ".###.", "#.#.#", "..#..", ".....", "....." } },
+    { '+', { ".....", "..#..", "..#..", "#####", "..#..", "..#..", ".....", "....." } },
+    { ',', { ".....", ".....", ".....", ".....", ".....", ".##..", "..#..", ".#..." } },
+    { '-', { ".....", ".....", ".....", "#####", ".....", ".....", ".....", "....." } },
+    { '.', { ".....", ".....", ".....", ".....", ".....", ".##..", ".##..", "....." } },
+    { '/', { ".....", "....#", "...#.", "..#..", ".#...", "#....", ".....", "....." } },
+    { '0', { ".###.", "#...#", "#..##", "#.#.#", "##..#", "#...#", ".###.", "....." } },
+    { '1', { "..#..", ".##..", "..#..", "..#..", "..#..", "..#..", ".###.", "....." } },
+    { '2', { ".###.", "#...#", "....#", "...#.", "..#..", ".#...", "#####", "....." } },
+    { '3', { "#####", "...#.", "..#..", "...#.", "....#", "#...#", ".###.", "....." } },
+    { '4', { "...#.", "..##.", ".#.#.", "#..#.", "#####", "...#.", "...#.", "....." } },
+    { '5', { "#####", "#....", "####.", "....#", "....#", "#...#", ".###.", "....." } },
+    { '6', { "..##.", ".#...", "#....", "####.", "#...#", "#...#", ".###.", "....." } },
+    { '7', { "#####", "....#", "...#.", "..#..", ".#...", ".#...", ".#...", "....." } },
+    { '8', { ".###.", "#...#", "#...#", ".###.", "#...#", "#...#", ".###.", "....." } },
+    { '9', { ".###.", "#...#", "#...#", ".####", "....#", "...#.", ".##..", "....." } },
+    { ':', { ".....", ".##..", ".##..", ".....", ".##..", ".##..", ".....", "....." } },
+    { ';', { ".....", ".##..", ".##..", ".....", ".##..", "..#..", ".#...", "....." } },
+    { '<', { "...#.", "..#..", ".#...", "#....", ".#...", "..#..", "...#.", "....." } },
+    { '=', { ".....", ".....", "#####", ".....", "#####", ".....", ".....", "....." } },
+    { '>', { ".#...", "..#..", "...#.", "....#", "...#.", "..#..", ".#...", "....." } },
+    { '?', { ".###.", "#...#", "....#", "...#.", "..#..", ".....", "..#..", "....." } },
+    { '@', { ".###.", "#...#", "....#", ".##.#", "#.#.#", "#.#.#", ".###.", "....." } },
+    { 'A', { ".###.", "#...#", "#...#", "#####", "#...#", "#...#", "#...#", "....." } },
+    { 'B', { "####.", "#...#", "#...#", "####.", "#...#", "#...#", "####.", "....." } },
+    { 'C', { ".###.", "#...#", "#....", "#....", "#....", "#...#", ".###.", "....." } },
+    { 'D', { "###..", "#..#.", "#...#", "#...#", "#...#", "#..#.", "###..", "....." } },
+    { 'E', { "#####", "#....", "#....", "####.", "#....", "#....", "#####", "....." } },
+    { 'F', { "#####", "#....", "#....", "####.", "#....", "#....", "#....", "....." } },
+    { 'G', { ".###.", "#...#", "#....", "#.###", "#...#", "#...#", ".####", "....." } },
+    { 'H', { "#...#", "#...#", "#...#", "#####", "#...#", "#...#", "#...#", "....." } },
+    { 'I', { ".###.", "..#..", "..#..", "..#..", "..#..", "..#..", ".###.", "....." } },
+    { 'J', { "..###", "...#.", "...#.", "...#.", "...#.", "#..#.", ".##..", "....." } },
+    { 'K', { "#...#", "#..#.", "#.#..", "##...", "#.#..", "#..#.", "#...#", "....." } },
+    { 'L', { "#....", "#....", "#....", "#....", "#....", "#....", "#####", "....." } },
+    { 'M', { "#...#", "##.##", "#.#.#", "#.#.#", "#...#", "#...#", "#...#", "....." } },
+    { 'N', { "#...#", "#...#", "##..#", "#.#.#", "#..##", "#...#", "#...#", "....." } },
+    { 'O', { ".###.", "#...#", "#...#", "#...#", "#...#", "#...#", ".###.", "....." } },
+    { 'P', { "####.", "#...#", "#...#", "####.", "#....", "#....", "#....", "....." } },
+    { 'Q', { ".###.", "#...#", "#...#", "#...#", "#.#.#", "#..#.", ".##.#", "....." } },
+    { 'R', { "####.", "#...#", "#...#", "####.", "#.#..", "#..#.", "#...#", "....." } },
+    { 'S', { ".####", "#....", "#....", ".###.", "....#", "....#", "####.", "....." } },
+    { 'T', { "#####", "..#..", "..#..", "..#..", "..#..", "..#..", "..#..", "....." } },
+    { 'U', { "#...#", "#...#", "#...#", "#...#", "#...#", "#...#", ".###.", "....." } },
+    { 'V', { "#...#", "#...#", "#...#", "#...#", "#...#", ".#.#.", "..#..", "....." } },
+    { 'W', { "#...#", "#...#", "#...#", "#.#.#", "#.#.#", "#.#.#", ".#.#.", "....." } },
+    { 'X', { "#...#", "#...#", ".#.#.", "..#..", ".#.#.", "#...#", "#...#", "....." } },
+    { 'Y', { "#...#", "#...#", ".#.#.", "..#..", "..#..", "..#..", "..#..", "....." } },
+    { 'Z', { "#####", "....#", "...#.", "..#..", ".#...", "#....", "#####", "....." } },
+    { '[', { ".###.", ".#...", ".#...", ".#...", ".#...", ".#...", ".###.", "....." } },
+    { '\\', { ".....", "#....", ".#...", "..#..", "...#.", "....#", ".....", "....." } },
+    { ']', { ".###.", "...#.", "...#.", "...#.", "...#.", "...#.", ".###.", "....." } },
+    { '^', { "..#..", ".#.#.", "#...#", ".....", ".....", ".....", ".....", "....." } },
+    { '_', { ".....", ".....", ".....", ".....", ".....", ".....", ".....", "#####" } },
+    { '`', { ".#...", "..#..", "...#.", ".....", ".....", ".....", ".....", "....." } },
+    { 'a', { ".....", ".....", ".###.", "....#", ".####", "#...#", ".####", "....." } },
+    { 'b', { "#....", "#....", "#.##.", "##..#", "#...#", "#...#", "####.", "....." } },
+    { 'c', { ".....", ".....", ".###.", "#....", "#....", "#...#", ".###.", "....." } },
+    { 'd', { "....#", "....#", ".##.#", "#..##", "#...#", "#...#", ".####", "....." } },
+    { 'e', { ".....", ".....", ".###.", "#...#", "#####", "#....", ".###.", "....." } },
+    { 'f', { "..##.", ".#..#", ".#...", "###..", ".#...", ".#...", ".#...", "....." } },
+    { 'g', { ".....", ".....", ".####", "#...#", "#...#", ".####", "....#", ".###." } },
+    { 'h', { "#....", "#....", "#.##.", "##..#", "#...#", "#...#", "#...#", "....." } },
+    { 'i', { "..#..", ".....", ".##..", "..#..", "..#..", "..#..", ".###.", "....." } },
+    { 'j', { "...#.", ".....", "..##.", "...#.", "...#.", "...#.", "#..#.", ".##.." } },
+    { 'k', { "#....", "#....", "#..#.", "#.#..", "##...", "#.#..", "#..#.", "....." } },
+    { 'l', { ".##..", "..#..", "..#..", "..#..", "..#..", "..#..", ".###.", "....." } },
+    { 'm', { ".....", ".....", "##.#.", "#.#.#", "#.#.#", "#...#", "#...#", "....." } },
+    { 'n', { ".....", ".....", "#.##.", "##..#", "#...#", "#...#", "#...#", "....." } },
+    { 'o', { ".....", ".....", ".###.", "#...#", "#...#", "#...#", ".###.", "....." } },
+    { 'p', { ".....", ".....", "####.", "#...#", "#...#", "####.", "#....", "#...." } },
+    { 'q', { ".....", ".....", ".####", "#...#", "#...#", ".####", "....#", "....#" } },
+    { 'r', { ".....", ".....", "#.##.", "##..#", "#....", "#....", "#....", "....." } },
+    { 's', { ".....", ".....", ".###.", "#....", ".###.", "....#", "####.", "....." } },
+    { 't', { ".#...", ".#...", "###..", ".#...", ".#...", ".#..#", "..##.", "....." } },
+    { 'u', { ".....", ".....", "#...#", "#...#", "#...#", "#..##", ".##.#", "....." } },
+    { 'v', { ".....", ".....", "#...#", "#...#", "#...#", ".#.#.", "..#..", "....." } },
+    { 'w', { ".....", ".....", "#...#", "#...#", "#.#.#", "#.#.#", ".#.#.", "....." } },
+    { 'x', { ".....", ".....", "#...#", ".#.#.", "..#..", ".#.#.", "#...#", "....." } },
+    { 'y', { ".....", ".....", "#...#", "#...#", "#...#", ".####", "....#", ".###." } },
+    { 'z', { ".....", ".....", "#####", "...#.", "..#..", ".#...", "#####", "....." } },
+    { '{', { "...#.", "..#..", "..#..", ".#...", "..#..", "..#..", "...#.", "....." } },
+    { '|', { "..#..", "..#..", "..#..", "..#..", "..#..", "..#..", "..#..", "....." } },
+    { '}', { ".#...", "..#..", "..#..", "...#.", "..#..", "..#..", ".#...", "....." } },
+    { '~', { ".....", ".....", ".#...", "#.#.#", "...#.", ".....", ".....", "....." } },
+} };
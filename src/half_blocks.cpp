@@ -0,0 +1,149 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "half_blocks.hpp"
+
+#include <algorithm>
+
+#include "alpha.hpp"
+#include "ansi_color.hpp"
+#include "luma.hpp"
+#include "trace.hpp"
+
+// Sums of the image rows [y_begin, y_end), one per byte of a row, instead of a strided walk
+// over each cell. As in CellRowAccumulator's kernels each block of bytes is added down the rows
+// into local lanes with a compile time length, which even -O2 turns into SIMD.
+static void sum_rows(const Color* pixels, size_t img_width, size_t y_begin, size_t y_end, std::vector<uint32_t>& sums)
+{
+    static constexpr size_t BLOCK = 16;
+
+    const auto* bytes = reinterpret_cast<const uint8_t*>(pixels);
+    const size_t stride = 3 * img_width;
+    const size_t blocked = sums.size() - sums.size() % BLOCK;
+
+    for(size_t i = 0; i < blocked; i += BLOCK) {
+        uint32_t lanes[BLOCK] { };
+        for(size_t y = y_begin; y < y_end; y++) {
+            for(size_t j = 0; j < BLOCK; j++) {
+                lanes[j] += bytes[y * stride + i + j];
+            }
+        }
+        std::copy(lanes, lanes + BLOCK, sums.begin() + static_cast<ptrdiff_t>(i));
+    }
+
+    for(size_t i = blocked; i < sums.size(); i++) {
+        uint32_t sum = 0;
+        for(size_t y = y_begin; y < y_end; y++) {
+            sum += bytes[y * stride + i];
+        }
+        sums[i] = sum;
+    }
+}
+
+// As sum_rows, in linear light for -l.
+static void sum_linear_rows(const Color* pixels, size_t img_width, size_t y_begin, size_t y_end, std::vector<uint64_t>& sums)
+{
+    std::fill(sums.begin(), sums.end(), 0);
+
+    for(size_t y = y_begin; y < y_end; y++) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(pixels + y * img_width);
+        for(size_t i = 0; i < sums.size(); i++) {
+            sums[i] += SRGB_TO_LINEAR[bytes[i]];
+        }
+    }
+}
+
+// Mean colour of the columns [x_begin, x_end) of row sums covering `rows` image rows.
+template<typename Sum>
+static Color half_mean(const std::vector<Sum>& sums, size_t x_begin, size_t x_end, size_t rows, bool linear)
+{
+    uint64_t cell[3] { };
+    for(size_t x = x_begin; x < x_end; x++) {
+        cell[0] += sums[3 * x];
+        cell[1] += sums[3 * x + 1];
+        cell[2] += sums[3 * x + 2];
+    }
+
+    const uint64_t count = std::max<uint64_t>(1, rows * (x_end - x_begin));
+    if(linear) {
+        return linear_mean(cell, count);
+    }
+
+    return Color {
+        static_cast<uint8_t>((cell[0] + count / 2) / count),
+        static_cast<uint8_t>((cell[1] + count / 2) / count),
+        static_cast<uint8_t>((cell[2] + count / 2) / count),
+    };
+}
+
+void half_block_conversion(const Configuration& config, std::string& out, const Color* pixels, const uint8_t* visible, size_t img_width, size_t img_height, double quad_width, double quad_height)
+{
+    const CellSpans columns = cell_spans(img_width, quad_width);
+    const CellSpans rows = cell_spans(img_height, quad_height);
+    const std::vector<uint8_t> blank = visible != nullptr ? blank_cells(visible, img_width, columns, rows) : std::vector<uint8_t> { };
+
+    // Worst case both layers change on every cell, plus a reset per row.
+    out.reserve(out.size() + columns.size() * rows.size() * (2 * 19 + UPPER_HALF_BLOCK.size()) + rows.size() * 5);
+
+    HalfBlockWriter writer(config.color_mode, config.color_tolerance);
+
+    // Each character row is summed a whole image row at a time into its top and bottom halves,
+    // then each cell takes its columns of those sums.
+    std::vector<uint32_t> top_sums(config.linear ? 0 : 3 * img_width);
+    std::vector<uint32_t> bottom_sums(top_sums.size());
+    std::vector<uint64_t> top_linear(config.linear ? 3 * img_width : 0);
+    std::vector<uint64_t> bottom_linear(top_linear.size());
+
+    for(size_t row = 0; row < rows.size(); row++) {
+        TraceScope band("convert band", "row", static_cast<int64_t>(row));
+
+        // A one pixel tall cell has no bottom half and repeats the top.
+        const size_t y_begin = rows.begin[row];
+        const size_t y_end = rows.end[row];
+        const size_t y_split = y_begin + (y_end - y_begin + 1) / 2;
+        const bool has_bottom = y_end > y_split;
+
+        if(config.linear) {
+            sum_linear_rows(pixels, img_width, y_begin, y_split, top_linear);
+            sum_linear_rows(pixels, img_width, y_split, y_end, bottom_linear);
+        } else {
+            sum_rows(pixels, img_width, y_begin, y_split, top_sums);
+            sum_rows(pixels, img_width, y_split, y_end, bottom_sums);
+        }
+
+        for(size_t col = 0; col < columns.size(); col++) {
+            if (!blank.empty() && blank[row * columns.size() + col] != 0) {
+                writer.write_blank(out);
+                continue;
+            }
+
+            const size_t x_begin = columns.begin[col];
+            const size_t x_end = columns.end[col];
+            Color top;
+            Color bottom;
+            if(config.linear) {
+                top = half_mean(top_linear, x_begin, x_end, y_split - y_begin, true);
+                bottom = has_bottom ? half_mean(bottom_linear, x_begin, x_end, y_end - y_split, true) : top;
+            } else {
+                top = half_mean(top_sums, x_begin, x_end, y_split - y_begin, false);
+                bottom = has_bottom ? half_mean(bottom_sums, x_begin, x_end, y_end - y_split, false) : top;
+            }
+            writer.write(out, top, bottom);
+        }
+
+        writer.end_row(out);
+    }
+}
@@ -0,0 +1,28 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "conversion.hpp"
+
+// UnicodeMode::HALF_BLOCKS: every cell is drawn by HalfBlockWriter with the mean colour of its
+// top and bottom halves. Each character row is summed a whole image row at a time, so the cost
+// is one pass over the image. Kept out of conversion.cpp so it is not inlined into
+// doAsciiConversion, where it slowed the glyph loop at -O2.
+void half_block_conversion(const Configuration& config, std::string& out, const Color* pixels, const uint8_t* visible, size_t img_width, size_t img_height, double quad_width, double quad_height);
@@ -0,0 +1,244 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "hdr.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "simd.hpp"
+
+// Steps of the linear 0-1 range in the sRGB encode table. Fine enough that a 16 bit code
+// lands within one level of its rounded 8 bit value, and off by one for under 1% of them.
+static constexpr size_t ENCODE_STEPS = 16384;
+
+// Channels converted per batch, so the float scratch stays in L1.
+static constexpr size_t BATCH = 3 * 256;
+
+// The tables are built on first use, so only 16 bit and HDR sources pay for their std::pow
+// calls rather than every run at startup.
+static const std::array<uint8_t, ENCODE_STEPS + 1>& linear_to_srgb()
+{
+    static const std::array<uint8_t, ENCODE_STEPS + 1> table = [] {
+        std::array<uint8_t, ENCODE_STEPS + 1> steps { };
+
+        for (size_t i = 0; i < steps.size(); i++) {
+            const double linear = static_cast<double>(i) / ENCODE_STEPS;
+            const double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1 / 2.4) - 0.055;
+            steps[i] = static_cast<uint8_t>(std::lround(encoded * 255));
+        }
+
+        return steps;
+    }();
+
+    return table;
+}
+
+static const std::vector<float>& srgb16_to_linear()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> codes(65536);
+
+        for (size_t i = 0; i < codes.size(); i++) {
+            const double encoded = static_cast<double>(i) / 65535;
+            codes[i] = static_cast<float>(encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4));
+        }
+
+        return codes;
+    }();
+
+    return table;
+}
+
+static ToneMap resolved_curve(const Configuration& config, bool hdr)
+{
+    if (config.tone_map != ToneMap::AUTO) {
+        return config.tone_map;
+    }
+
+    return hdr ? ToneMap::REINHARD : ToneMap::CLAMP;
+}
+
+// Exposure and curve of one vector of channels, with the result scaled to table steps. NaN
+// comes out as 0 and +inf (NaN after the Reinhard and filmic divisions) as full scale.
+template<typename Vec>
+static Vec map_channels(Vec linear, ToneMap curve, float scale)
+{
+    const Vec zero = Vec::broadcast(0);
+    const Vec one = Vec::broadcast(1);
+    const Vec x = max(linear * Vec::broadcast(scale), zero);
+
+    Vec mapped;
+    if (curve == ToneMap::REINHARD) {
+        mapped = x / (one + x);
+    } else if (curve == ToneMap::FILMIC) {
+        // Narkowicz's fit of the ACES reference curve.
+        const Vec numerator = x * (Vec::broadcast(2.51f) * x + Vec::broadcast(0.03f));
+        const Vec denominator = x * (Vec::broadcast(2.43f) * x + Vec::broadcast(0.59f)) + Vec::broadcast(0.14f);
+        mapped = numerator / denominator;
+    } else {
+        mapped = x;
+    }
+
+    return min(mapped, one) * Vec::broadcast(static_cast<float>(ENCODE_STEPS));
+}
+
+// Maps `size` linear channels in place and writes their sRGB codes to `out`.
+static void encode_batch(float* channels, size_t size, ToneMap curve, float scale, uint8_t* out)
+{
+    size_t i = 0;
+    for (; i + Float4::WIDTH <= size; i += Float4::WIDTH) {
+        map_channels(Float4::load(channels + i), curve, scale).store(channels + i);
+    }
+    for (; i < size; i++) {
+        map_channels(Float1::load(channels + i), curve, scale).store(channels + i);
+    }
+
+    const auto& encode = linear_to_srgb();
+    for (i = 0; i < size; i++) {
+        const auto step = static_cast<uint32_t>(static_cast<int32_t>(channels[i] + 0.5f));
+        out[i] = encode[std::min<uint32_t>(step, ENCODE_STEPS)];
+    }
+}
+
+std::unique_ptr<Color[]> tone_map_float(const Configuration& config, const float* channels, size_t count)
+{
+    auto pixels { std::make_unique<Color[]>(count) };
+    auto* out = reinterpret_cast<uint8_t*>(pixels.get());
+
+    const ToneMap curve = resolved_curve(config, true);
+    const auto scale = static_cast<float>(std::exp2(config.exposure));
+    std::array<float, BATCH> scratch;
+
+    for (size_t begin = 0; begin < 3 * count; begin += BATCH) {
+        const size_t size = std::min(BATCH, 3 * count - begin);
+        std::copy(channels + begin, channels + begin + size, scratch.begin());
+        encode_batch(scratch.data(), size, curve, scale, out + begin);
+    }
+
+    return pixels;
+}
+
+// A 16 bit code rounded to the nearest 8 bit one.
+static uint8_t narrow_16(uint16_t code) { return static_cast<uint8_t>((code * 255U + 32767) / 65535); }
+
+// Rounds `size` 16 bit codes to 8 bits, in blocks with a compile time length so even -O2
+// turns them into SIMD.
+static void narrow_codes(const uint16_t* __restrict codes, size_t size, uint8_t* __restrict out)
+{
+    static constexpr size_t BLOCK = 16;
+
+    size_t i = 0;
+    for (; i + BLOCK <= size; i += BLOCK) {
+        for (size_t j = 0; j < BLOCK; j++) {
+            out[i + j] = narrow_16(codes[i + j]);
+        }
+    }
+    for (; i < size; i++) {
+        out[i] = narrow_16(codes[i]);
+    }
+}
+
+// Clamping without exposure leaves a 16 bit sRGB code where it is, so it only needs rounding
+// to 8 bits rather than the round trip through linear light and the encode table.
+static bool narrows_directly(const Configuration& config)
+{
+    return resolved_curve(config, false) == ToneMap::CLAMP && config.exposure == 0;
+}
+
+std::unique_ptr<Color[]> tone_map_16(const Configuration& config, const uint16_t* channels, size_t count)
+{
+    auto pixels { std::make_unique<Color[]>(count) };
+    auto* out = reinterpret_cast<uint8_t*>(pixels.get());
+
+    if (narrows_directly(config)) {
+        narrow_codes(channels, 3 * count, out);
+        return pixels;
+    }
+
+    const ToneMap curve = resolved_curve(config, false);
+    const auto scale = static_cast<float>(std::exp2(config.exposure));
+    const std::vector<float>& decode = srgb16_to_linear();
+    std::array<float, BATCH> scratch;
+
+    for (size_t begin = 0; begin < 3 * count; begin += BATCH) {
+        const size_t size = std::min(BATCH, 3 * count - begin);
+        for (size_t i = 0; i < size; i++) {
+            scratch[i] = decode[channels[begin + i]];
+        }
+        encode_batch(scratch.data(), size, curve, scale, out + begin);
+    }
+
+    return pixels;
+}
+
+static float linear(float channel) { return channel; }
+static float linear(uint16_t channel) { return srgb16_to_linear()[channel]; }
+
+// Alpha is coverage, not light: it is only brought down to 8 bits, never tone mapped.
+static uint8_t alpha_8(float alpha) { return alpha == alpha ? static_cast<uint8_t>(std::clamp(alpha, 0.0f, 1.0f) * 255 + 0.5f) : 0; }
+static uint8_t alpha_8(uint16_t alpha) { return narrow_16(alpha); }
+
+// Colour channels are gathered a batch at a time, encoded as above and interleaved back with
+// their pixel's alpha.
+template<typename Channel>
+static std::unique_ptr<uint8_t[]> tone_map_rgba(const Configuration& config, bool hdr, const Channel* channels, size_t count)
+{
+    auto pixels { std::make_unique<uint8_t[]>(4 * count) };
+
+    const ToneMap curve = resolved_curve(config, hdr);
+    const auto scale = static_cast<float>(std::exp2(config.exposure));
+    std::array<float, BATCH> scratch;
+    std::array<uint8_t, BATCH> encoded;
+
+    for (size_t first = 0; first < count; first += BATCH / 3) {
+        const size_t size = std::min(BATCH / 3, count - first);
+        const Channel* in = channels + 4 * first;
+        uint8_t* out = pixels.get() + 4 * first;
+
+        for (size_t i = 0; i < size; i++) {
+            for (size_t channel = 0; channel < 3; channel++) {
+                scratch[3 * i + channel] = linear(in[4 * i + channel]);
+            }
+        }
+        encode_batch(scratch.data(), 3 * size, curve, scale, encoded.data());
+
+        for (size_t i = 0; i < size; i++) {
+            std::copy_n(encoded.data() + 3 * i, 3, out + 4 * i);
+            out[4 * i + 3] = alpha_8(in[4 * i + 3]);
+        }
+    }
+
+    return pixels;
+}
+
+std::unique_ptr<uint8_t[]> tone_map_float_rgba(const Configuration& config, const float* channels, size_t count)
+{
+    return tone_map_rgba(config, true, channels, count);
+}
+
+std::unique_ptr<uint8_t[]> tone_map_16_rgba(const Configuration& config, const uint16_t* channels, size_t count)
+{
+    if (narrows_directly(config)) {
+        auto pixels { std::make_unique<uint8_t[]>(4 * count) };
+        narrow_codes(channels, 4 * count, pixels.get());
+        return pixels;
+    }
+
+    return tone_map_rgba(config, false, channels, count);
+}
@@ -0,0 +1,39 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "conversion.hpp"
+
+// 16 bit and HDR sources are brought down to the 8 bit sRGB image every mode reads: each
+// channel is decoded to linear light, scaled by 2^config.exposure, taken into 0-1 by
+// config.tone_map and encoded back to sRGB. Channels are processed four at a time. A 16 bit
+// source clamped without exposure is already sRGB in range, so it is only rounded to 8 bits.
+
+// `count` pixels of three linear light floats each, as stbi_loadf returns them.
+std::unique_ptr<Color[]> tone_map_float(const Configuration& config, const float* channels, size_t count);
+
+// `count` pixels of three 16 bit sRGB channels each, as stbi_load_16 returns them.
+std::unique_ptr<Color[]> tone_map_16(const Configuration& config, const uint16_t* channels, size_t count);
+
+// The same for four channel sources, into 8 bit RGBA for flatten_alpha or doRgbaConversion.
+// Alpha is carried through at 8 bits, not tone mapped.
+std::unique_ptr<uint8_t[]> tone_map_float_rgba(const Configuration& config, const float* channels, size_t count);
+std::unique_ptr<uint8_t[]> tone_map_16_rgba(const Configuration& config, const uint16_t* channels, size_t count);
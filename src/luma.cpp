@@ -0,0 +1,64 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "luma.hpp"
+
+#include <algorithm>
+
+const std::array<uint16_t, 256> SRGB_TO_LINEAR = [] {
+    std::array<uint16_t, 256> table { };
+
+    for (size_t i = 0; i < table.size(); i++) {
+        const double encoded = static_cast<double>(i) / 255;
+        const double linear = encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+        table[i] = static_cast<uint16_t>(std::lround(linear * 65535));
+    }
+
+    return table;
+}();
+
+// Nearest sRGB code for a 16 bit linear value; a binary search of the decode table, only
+// done once per cell.
+static uint8_t linear_to_srgb(uint64_t linear)
+{
+    const auto next = std::lower_bound(SRGB_TO_LINEAR.begin(), SRGB_TO_LINEAR.end(), linear);
+
+    if (next == SRGB_TO_LINEAR.begin()) {
+        return 0;
+    }
+
+    if (next == SRGB_TO_LINEAR.end()) {
+        return 255;
+    }
+
+    const auto index = static_cast<uint8_t>(next - SRGB_TO_LINEAR.begin());
+    return linear - *(next - 1) < *next - linear ? static_cast<uint8_t>(index - 1) : index;
+}
+
+Color linear_mean(const uint64_t* sums, uint64_t count)
+{
+    return {
+        linear_to_srgb((sums[0] + count / 2) / count),
+        linear_to_srgb((sums[1] + count / 2) / count),
+        linear_to_srgb((sums[2] + count / 2) / count),
+    };
+}
+
+float encode_linear_luma(float linear)
+{
+    const double value = std::clamp(static_cast<double>(linear), 0.0, 1.0);
+    return static_cast<float>(value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1 / 2.4) - 0.055);
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "conversion.hpp"
+
+static constexpr double RED_WEIGHT_PERC = 0.299;
+static constexpr double GREEN_WEIGHT_PERC = 0.587;
+static constexpr double BLUE_WEIGHT_PERC = 0.114;
+
+static constexpr double RED_WEIGHT = 0.2126;
+static constexpr double GREEN_WEIGHT = 0.7152;
+static constexpr double BLUE_WEIGHT = 0.0722;
+
+static constexpr double LUMA_MAX = 255;
+
+constexpr double luma(const Color& pixel)
+{
+    const auto red = static_cast<double>(pixel.red);
+    const auto green = static_cast<double>(pixel.green);
+    const auto blue = static_cast<double>(pixel.blue);
+
+    return (RED_WEIGHT * red + GREEN_WEIGHT * green + BLUE_WEIGHT * blue) / LUMA_MAX;
+}
+
+constexpr double perceived_luma_fast(const Color& pixel)
+{
+    const auto red = static_cast<double>(pixel.red);
+    const auto green = static_cast<double>(pixel.green);
+    const auto blue = static_cast<double>(pixel.blue);
+
+    return (RED_WEIGHT_PERC * red + GREEN_WEIGHT_PERC * green + BLUE_WEIGHT_PERC * blue) / LUMA_MAX;
+}
+
+constexpr double perceived_luma(const Color& pixel)
+{
+    const auto red = static_cast<double>(pixel.red);
+    const auto green = static_cast<double>(pixel.green);
+    const auto blue = static_cast<double>(pixel.blue);
+
+    return sqrt(RED_WEIGHT_PERC * red * red + GREEN_WEIGHT_PERC * green * green + BLUE_WEIGHT_PERC * blue * blue) / LUMA_MAX;
+}
+
+constexpr double configured_luma(const Configuration& config, const Color& pixel)
+{
+    if (config.alt) {
+        return perceived_luma_fast(pixel);
+    } else if (config.perceived) {
+        return perceived_luma(pixel);
+    } else {
+        return luma(pixel);
+    }
+}
+
+// sRGB transfer function decoded to 16 bit linear light, for -l.
+extern const std::array<uint16_t, 256> SRGB_TO_LINEAR;
+
+// Mean of 16 bit linear channel sums over `count` pixels, re-encoded to sRGB.
+Color linear_mean(const uint64_t* sums, uint64_t count);
+
+// Linear light luma (0-1) re-encoded with the sRGB transfer function, for cells of a luma
+// plane averaged under -l.
+float encode_linear_luma(float linear);
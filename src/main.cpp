@@ -14,11 +14,30 @@
    limitations under the License.
  */
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <fstream>
 #include <iostream>
 
+#include "alpha.hpp"
+#include "animation.hpp"
+#include "bench.hpp"
+#include "conversion.hpp"
+#include "hdr.hpp"
+#include "perf_counters.hpp"
+#include "progressive.hpp"
+#include "trace.hpp"
+
 #define STB_IMAGE_IMPLEMENTATION
 
 #if defined(__clang__)
@@ -49,8 +68,6 @@
 
 #include <string_view>
 
-static constexpr std::string_view DENSITY{ "@QB#NgWM8RDHdOKq9$6khEPXwmeZaoS2yjufF]}{tx1zv7lciL/\\|?*>r^;:_\"~,'.-`" };
-
 static constexpr const char* USAGE =
     R"(Image To Ascii
 Usage:
@@ -62,61 +79,130 @@ Options:
                    columns will be calculated from aspect ratio if not provided.
 
         -a         Use fast perceived luminance algorithm
+        -e         Draw strong straight edges with line glyphs (| - _ / \)
+                   instead of their brightness.
         -h, --help Show this message.
         -i         Invert brightness
+        -l         Average each cell in linear light, so fine high-contrast
+                   detail does not come out darker than it looks. --sharpen,
+                   --filter and -e work on linear light luma too.
         -n NUMBER  Number of spaces (' ') at the end of the density string. Default: 9
         -o FILE    Output path
         -p         Use perceived luminance
         -r RATIO   Font ratio for better sizing. RATIO is in the
                    format (FONT WIDTH:FONT HEIGHT) or (FONT WIDTH/FONT HEIGHT).
                    The default is 1:2.
+        -s         Pick each glyph by matching the shape of the ink in the
+                   cell (3x5 samples) against every printable character,
+                   instead of by average brightness.
+
+        --sharpen AMOUNT
+                   Unsharp mask the brightness before it is averaged into
+                   cells, so detail lost to downscaling stands out. 1 doubles
+                   the local contrast. Default: 0 (off)
+        --sharpen-radius PIXELS
+                   Blur radius the sharpening compares against. Default: half
+                   a cell
+        --brightness B
+                   Add B (-1 to 1) to every cell's brightness. Default: 0
+        --contrast C
+                   Scale brightness differences around mid grey by C.
+                   Default: 1
+        --gamma G  Brighten (G > 1) or darken (G < 1) the mid tones. Default: 1
+        --tonemap CURVE
+                   How 16-bit and HDR (.hdr) images are brought into range:
+                   'clamp' (default for 16-bit), 'reinhard' (default for HDR)
+                   or 'filmic'.
+        --exposure STOPS
+                   Scale 16-bit and HDR images by 2^STOPS before tone mapping.
+                   Default: 0
+        --background COLOR
+                   Colour transparent pixels are blended over, as RRGGBB hex.
+                   'none' averages each cell over its visible pixels only
+                   (modes that need whole cells blend over black instead).
+                   Cells with no visible pixel are left blank. Default: 000000
+        --filter FILTER
+                   How cells are sampled: 'box' (default) averages the whole
+                   pixels under a cell, 'area' also weighs pixels the cell
+                   only partly covers, 'bilinear', 'gaussian' and 'lanczos'
+                   blend in neighbouring pixels for smoother output.
+        --upscale FILTER
+                   How cells smaller than a pixel (-W or -H larger than the
+                   image) are filled in: 'nearest' (default) repeats the pixel
+                   under each cell, 'bilinear' blends the four around it.
+                   Modes that need whole cells (see --progressive) always
+                   repeat the pixel.
+        --reduce MODE
+                   How each cell's brightness is taken from its pixels: 'mean'
+                   (default), 'min', 'max', 'median', or a percentile (0-100).
+                   'max' keeps single bright specks, 'min' thin dark lines.
+        --quality LEVEL
+                   Read at most a 2x2 (1), 4x4 (2), 8x8 (3) or 16x16 (4)
+                   jittered grid of pixels per cell instead of all of them,
+                   for fast previews of very large images. 'full' (default)
+                   reads every pixel.
+        --progressive
+                   Print a coarse --quality 1 and then 3 render straight away
+                   and draw each refinement over the last one, ending with the
+                   full (or --quality) render. Terminal output only; ignored
+                   with -o and by the modes that need whole cells (-e, -s,
+                   --unicode, --sharpen, --filter, --equalize, --reduce).
+        --equalize MODE
+                   Spread the brightness of low-contrast images over the whole
+                   density ramp. MODE is 'stretch' (1st-99th percentile),
+                   'global' (histogram equalization) or 'clahe' (per region,
+                   contrast limited).
+        --clahe-limit N
+                   Highest gain 'clahe' may give a brightness level, as a
+                   multiple of the mean. Default: 2.5
+        --dither MODE
+                   Dither the density ramp to hide banding in gradients. MODE
+                   is 'floyd-steinberg', 'atkinson', 'bayer' or 'noise'.
+        --unicode MODE
+                   Draw each cell as a pattern of dots instead of a character.
+                   MODE is 'braille' (2x4 dots) or 'quadrant' (2x2 blocks).
+                   'half' draws two colours per cell instead (top and bottom
+                   halves), in truecolor unless --color 256 is given.
+        --dot-threshold INK
+                   Ink level (0-1) a dot needs for --unicode to draw it.
+                   Default: 0.5
+        --edge-threshold CONTRAST
+                   Minimum brightness step (0-1) across an edge for -e to draw
+                   it. Default: 0.2
+        --color MODE
+                   Colour the glyphs with each cell's average colour. MODE is
+                   'truecolor' (24-bit) or '256' (xterm palette).
+        --color-tolerance N
+                   Keep the current colour while every channel is within N
+                   (0-255) of it, trading accuracy for fewer escape codes.
+                   Default: 0
+
+        Animated GIFs are converted a frame per core and played back in
+        place at their own frame delays, or with -o written out one after
+        another, each under a '--- frame N/COUNT, DELAY ms ---' line.
+
+        --perf-counters
+                   Print wall time and hardware counters (cycles, instructions,
+                   cache and branch misses) for the decode, convert and output
+                   phases to stderr.
+        --trace FILE
+                   Record load, copy, convert and write events as a Chrome
+                   trace (chrome://tracing, ui.perfetto.dev) in FILE.
+
+        --bench    Run the built-in benchmark workloads and print the results
+                   in baseline format (see bench/baselines-*.txt).
+        --bench-baseline FILE
+                   Run the benchmarks and fail if any workload's output changed,
+                   the reference workload's time grew 1.5x or another's time
+                   relative to the reference grew 1.5x against the baselines in
+                   FILE.
+        --bench-palette
+                   Measure the 256-colour lookup table against an exhaustive
+                   palette search.
 )";
 
-static constexpr double RED_WEIGHT_PERC = 0.299;
-static constexpr double GREEN_WEIGHT_PERC = 0.587;
-static constexpr double BLUE_WEIGHT_PERC = 0.114;
-
-static constexpr double RED_WEIGHT = 0.2126;
-static constexpr double GREEN_WEIGHT = 0.7152;
-static constexpr double BLUE_WEIGHT = 0.0722;
-
-static constexpr double LUMA_MAX = 255;
-
 static constexpr char RATIO_DELIM[3] = ":/";
 
-struct Color
-{
-    uint8_t red;
-    uint8_t green;
-    uint8_t blue;
-};
-
-struct Quad
-{
-    double top_left_x;
-    double top_left_y;
-    double width;
-    double height;
-};
-
-struct Configuration
-{
-    bool print_usage = false;
-    bool inverted = false;
-    bool perceived = false;
-    bool alt = false;
-
-    uint32_t cols = -1U;
-    uint32_t rows = -1U;
-
-    double font_ratio = 0.5;
-
-    size_t num_spaces = 9;
-
-    std::string_view input_path { };
-    std::string_view output_path { };
-};
-
 constexpr uint32_t clamp(uint32_t x, uint32_t min, uint32_t max) {
     if(x < min) {
         return min;
@@ -129,89 +215,155 @@ constexpr uint32_t clamp(uint32_t x, uint32_t min, uint32_t max) {
     return x;
 }
 
-constexpr double luma(const Color& pixel)
+void parse_long_arg_value(Configuration& config, const std::string_view& option, const std::string_view& value)
 {
-    const auto red = static_cast<double>(pixel.red);
-    const auto green = static_cast<double>(pixel.green);
-    const auto blue = static_cast<double>(pixel.blue);
-
-    return (RED_WEIGHT * red + GREEN_WEIGHT * green + BLUE_WEIGHT * blue) / LUMA_MAX;
-}
-
-constexpr double perceived_luma_fast(const Color& pixel)
-{
-    const auto red = static_cast<double>(pixel.red);
-    const auto green = static_cast<double>(pixel.green);
-    const auto blue = static_cast<double>(pixel.blue);
-
-    return (RED_WEIGHT_PERC * red + GREEN_WEIGHT_PERC * green + BLUE_WEIGHT_PERC * blue) / LUMA_MAX;
-}
-
-constexpr double perceived_luma(const Color& pixel)
-{
-    const auto red = static_cast<double>(pixel.red);
-    const auto green = static_cast<double>(pixel.green);
-    const auto blue = static_cast<double>(pixel.blue);
-
-    return sqrt(RED_WEIGHT_PERC * red * red + GREEN_WEIGHT_PERC * green * green + BLUE_WEIGHT_PERC * blue * blue) / LUMA_MAX;
-}
-
-constexpr double average_luma(const Configuration& config, const std::unique_ptr<Color>& pixels, const Quad& region, size_t img_width, size_t img_height)
-{
-    double luma_accumulator = 0;
-    double pixel_count = 0;
-
-    for(size_t y = static_cast<size_t>(region.top_left_y); y < std::min(img_height, static_cast<size_t>(region.top_left_y + region.height)); y++) {
-        for(size_t x = static_cast<size_t>(region.top_left_x); x < std::min(img_width, static_cast<size_t>(region.top_left_x + region.width)); x++) {
-            Color pixel = pixels.get()[x + y * img_width];
-            if (config.alt) {
-                luma_accumulator += perceived_luma_fast(pixel);
-            } else if (config.perceived) {
-                luma_accumulator += perceived_luma(pixel);
-            } else {
-                luma_accumulator += luma(pixel);
-            }
-
-            pixel_count++;
+    if(option == "trace") {
+        config.trace_path = value;
+    } else if(option == "color") {
+        if(value == "truecolor" || value == "24bit") {
+            config.color_mode = ColorMode::TRUECOLOR;
+        } else if(value == "256") {
+            config.color_mode = ColorMode::XTERM_256;
+        } else {
+            config.print_usage = true;
         }
-    }
-
-    if(pixel_count == 0) {
-        return luma_accumulator;
-    } else {
-        return luma_accumulator / pixel_count;
-    }
-}
-
-void doAsciiConversion(const Configuration& config, std::ostream& out, const std::unique_ptr<Color>& pixels, size_t img_width, size_t img_height) {
-    double quad_width = static_cast<double>(img_width) / static_cast<double>(config.cols);
-    double quad_height = static_cast<double>(img_height) / (static_cast<double>(config.rows) * config.font_ratio);
-
-    for (double y = 0; y < static_cast<double>(img_height); y += quad_height) {
-        for (double x = 0; x < static_cast<double>(img_width); x += quad_width) {
-            Quad char_quad { x, y, quad_width, quad_height };
-            double luminance = average_luma(config, pixels, char_quad, img_width, img_height);
-
-            if (!config.inverted) {
-                luminance = (1 - luminance);
-            }
-
-            auto index = static_cast<size_t>(static_cast<double>(DENSITY.size() + config.num_spaces - 1) * luminance);
-
-            if (index >= DENSITY.size()) {
-                out << ' ';
+    } else if(option == "sharpen") {
+        config.sharpen = std::stod(value.data());
+    } else if(option == "sharpen-radius") {
+        config.sharpen_radius = std::stoull(value.data());
+    } else if(option == "brightness") {
+        config.brightness = std::stod(value.data());
+    } else if(option == "contrast") {
+        config.contrast = std::stod(value.data());
+    } else if(option == "gamma") {
+        config.gamma = std::stod(value.data());
+    } else if(option == "tonemap") {
+        if(value == "clamp") {
+            config.tone_map = ToneMap::CLAMP;
+        } else if(value == "reinhard") {
+            config.tone_map = ToneMap::REINHARD;
+        } else if(value == "filmic") {
+            config.tone_map = ToneMap::FILMIC;
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "exposure") {
+        config.exposure = std::stod(value.data());
+    } else if(option == "background") {
+        const std::string_view hex = value.starts_with('#') ? value.substr(1) : value;
+        unsigned rgb = 0;
+        const auto result = std::from_chars(hex.data(), hex.data() + hex.size(), rgb, 16);
+
+        if(value == "none") {
+            config.alpha_weighted = true;
+        } else if(hex.size() == 6 && result.ec == std::errc { } && result.ptr == hex.data() + hex.size()) {
+            config.alpha_weighted = false;
+            config.background = { static_cast<uint8_t>(rgb >> 16), static_cast<uint8_t>(rgb >> 8), static_cast<uint8_t>(rgb) };
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "filter") {
+        if(value == "box") {
+            config.filter = ResampleFilter::BOX;
+        } else if(value == "area") {
+            config.filter = ResampleFilter::AREA;
+        } else if(value == "bilinear") {
+            config.filter = ResampleFilter::BILINEAR;
+        } else if(value == "gaussian") {
+            config.filter = ResampleFilter::GAUSSIAN;
+        } else if(value == "lanczos") {
+            config.filter = ResampleFilter::LANCZOS;
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "upscale") {
+        if(value == "nearest") {
+            config.upscale = UpscaleFilter::NEAREST;
+        } else if(value == "bilinear") {
+            config.upscale = UpscaleFilter::BILINEAR;
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "reduce") {
+        if(value == "mean") {
+            config.reducer = CellReducer::MEAN;
+        } else if(value == "min") {
+            config.reducer = CellReducer::MIN;
+        } else if(value == "max") {
+            config.reducer = CellReducer::MAX;
+        } else if(value == "median") {
+            config.reducer = CellReducer::MEDIAN;
+        } else {
+            config.reducer = CellReducer::PERCENTILE;
+            config.percentile = std::stod(value.data());
+        }
+    } else if(option == "quality") {
+        if(value == "full") {
+            config.quality = 0;
+        } else {
+            const int level = std::stoi(value.data());
+            if(level < 1 || level > 4) {
+                config.print_usage = true;
             } else {
-                out << DENSITY[index];
+                config.quality = static_cast<uint32_t>(level);
             }
         }
-
-        out << '\n';
+    } else if(option == "equalize") {
+        if(value == "stretch") {
+            config.contrast_mode = ContrastMode::STRETCH;
+        } else if(value == "global") {
+            config.contrast_mode = ContrastMode::EQUALIZE;
+        } else if(value == "clahe") {
+            config.contrast_mode = ContrastMode::CLAHE;
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "clahe-limit") {
+        config.clahe_limit = std::stod(value.data());
+    } else if(option == "dither") {
+        if(value == "floyd-steinberg" || value == "fs") {
+            config.dither_mode = DitherMode::FLOYD_STEINBERG;
+        } else if(value == "atkinson") {
+            config.dither_mode = DitherMode::ATKINSON;
+        } else if(value == "bayer") {
+            config.dither_mode = DitherMode::BAYER;
+        } else if(value == "noise") {
+            config.dither_mode = DitherMode::NOISE;
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "unicode") {
+        if(value == "braille") {
+            config.unicode_mode = UnicodeMode::BRAILLE;
+        } else if(value == "quadrant" || value == "quadrants") {
+            config.unicode_mode = UnicodeMode::QUADRANTS;
+        } else if(value == "half") {
+            config.unicode_mode = UnicodeMode::HALF_BLOCKS;
+        } else {
+            config.print_usage = true;
+        }
+    } else if(option == "dot-threshold") {
+        config.dot_threshold = std::stod(value.data());
+    } else if(option == "edge-threshold") {
+        config.edge_threshold = std::stod(value.data());
+    } else if(option == "color-tolerance") {
+        config.color_tolerance = static_cast<uint8_t>(std::clamp(std::stoi(value.data()), 0, 255));
+    } else if(option == "bench-baseline") {
+        config.bench = true;
+        config.bench_baseline = value;
     }
 }
 
 void parse_arg(Configuration& config, const std::string_view& arg)
 {
     static char previous_arg = '\0';
+    static std::string_view previous_long_arg { };
+
+    if(!previous_long_arg.empty()) {
+        parse_long_arg_value(config, previous_long_arg, arg);
+        previous_long_arg = { };
+        return;
+    }
 
     if(!arg.starts_with('-')) {
         switch(previous_arg) {
@@ -220,7 +372,7 @@ void parse_arg(Configuration& config, const std::string_view& arg)
             case 'n': config.num_spaces = std::stoull(arg.data()); break;
             case 'o': config.output_path = arg; break;
             case 'r': {
-                const auto buffer { std::make_unique<char>(arg.length()) };
+                const auto buffer { std::make_unique<char[]>(arg.length() + 1) };
                 strcpy(buffer.get(), arg.data());
                 const char* x_part = strtok(buffer.get(), RATIO_DELIM);
                 const char* y_part = strtok(nullptr, RATIO_DELIM);
@@ -240,8 +392,24 @@ void parse_arg(Configuration& config, const std::string_view& arg)
         return;
     }
 
-    if(arg.starts_with("--") && (strcmp("--help", arg.data()) == 0)) {
-        config.print_usage = true;
+    if(arg.starts_with("--")) {
+        const std::string_view option = arg.substr(2);
+
+        if(option == "perf-counters") {
+            config.perf_counters = true;
+        } else if(option == "bench") {
+            config.bench = true;
+        } else if(option == "bench-palette") {
+            config.bench_palette = true;
+        } else if(option == "progressive") {
+            config.progressive = true;
+        } else if(option == "trace" || option == "sharpen" || option == "sharpen-radius" || option == "brightness" || option == "contrast" || option == "gamma" || option == "tonemap" || option == "exposure" || option == "background" || option == "filter" || option == "upscale" || option == "reduce" || option == "quality" || option == "equalize" || option == "clahe-limit" || option == "dither" || option == "unicode" || option == "dot-threshold" || option == "edge-threshold" || option == "color" || option == "color-tolerance" || option == "bench-baseline") {
+            previous_long_arg = option;
+        } else {
+            // --help, and anything we don't recognise
+            config.print_usage = true;
+        }
+
         return;
     }
 
@@ -260,9 +428,12 @@ void parse_arg(Configuration& config, const std::string_view& arg)
             case 'r': previous_arg = a; break;
 
             case 'a': config.alt = true; break;
+            case 'e': config.edges = true; break;
             case 'h': config.print_usage = true; break;
             case 'i': config.inverted = true; break;
+            case 'l': config.linear = true; break;
             case 'p': config.perceived = true; break;
+            case 's': config.shapes = true; break;
             default: config.print_usage = true; break;
         }
     }
@@ -287,17 +458,232 @@ Configuration parse_command_line_args(int args, char* argv[])
     return res;
 }
 
+// Coarse levels --progressive prints before the final render.
+static constexpr std::array<uint32_t, 2> PROGRESSIVE_LEVELS { 1, 3 };
+
+// Draws `frame` over `previous`, already on screen with the cursor just below it: goes back
+// to its first line and rewrites only the lines that changed, stepping over the rest.
+static void write_over(std::ostream& out, std::string_view frame, std::string_view previous)
+{
+    if(previous.empty()) {
+        out.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+        return;
+    }
+
+    out << "\x1b[" << std::count(previous.begin(), previous.end(), '\n') << 'F';
+
+    while(!frame.empty()) {
+        const size_t frame_end = std::min(frame.size(), frame.find('\n') + 1);
+        const size_t previous_end = std::min(previous.size(), previous.find('\n') + 1);
+
+        if(frame.substr(0, frame_end) == previous.substr(0, previous_end)) {
+            out << "\x1b[E";
+        } else {
+            out.write(frame.data(), static_cast<std::streamsize>(frame_end));
+        }
+
+        frame.remove_prefix(frame_end);
+        previous.remove_prefix(previous_end);
+    }
+}
+
+// Every frame of a GIF, RGBA and back to back, with each one's delay in milliseconds. Empty
+// (null pixels) unless `path` is a GIF; one of a single frame is converted as a still image.
+struct GifFrames
+{
+    uint8_t* pixels = nullptr;
+    int* delays = nullptr;
+    int width = 0;
+    int height = 0;
+    int count = 0;
+};
+
+static GifFrames load_gif_frames(std::string_view path)
+{
+    std::ifstream file(path.data(), std::ios::binary);
+    char magic[4] { };
+    if(!file.read(magic, sizeof(magic)) || memcmp(magic, "GIF8", sizeof(magic)) != 0) {
+        return { };
+    }
+
+    file.seekg(0);
+    const std::vector<char> bytes { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    GifFrames gif;
+    int channels = 0;
+    gif.pixels = stbi_load_gif_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()), static_cast<int>(bytes.size()), &gif.delays, &gif.width, &gif.height, &gif.count, &channels, 4);
+
+    return gif;
+}
+
+// Like browsers, takes delays of 10 ms or less (often 0, meaning "as fast as possible") as 100.
+static std::chrono::milliseconds frame_delay(int delay)
+{
+    return std::chrono::milliseconds(delay <= 10 ? 100 : delay);
+}
+
+// Shows each frame over the last for its delay, redrawing only the lines that changed.
+// Deadlines are absolute, so slow writes do not add up.
+static void play_frames(std::ostream& out, const std::vector<std::string>& frames, const int* delays)
+{
+    auto deadline = std::chrono::steady_clock::now();
+    std::string_view previous;
+
+    for(size_t frame = 0; frame < frames.size(); frame++) {
+        write_over(out, frames[frame], previous);
+        out.flush();
+        previous = frames[frame];
+
+        deadline += frame_delay(delays[frame]);
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+static void write_frames(std::ostream& out, const std::vector<std::string>& frames, const int* delays)
+{
+    for(size_t frame = 0; frame < frames.size(); frame++) {
+        out << "--- frame " << frame + 1 << '/' << frames.size() << ", " << frame_delay(delays[frame]).count() << " ms ---\n";
+        out.write(frames[frame].data(), static_cast<std::streamsize>(frames[frame].size()));
+    }
+}
+
 int main(int args, char* argv[])
 {
     Configuration config = parse_command_line_args(args, argv);
 
+    if (config.bench_palette && !config.print_usage) {
+        return run_palette_benchmark(std::cout);
+    }
+
+    if (config.bench && !config.print_usage) {
+        return run_benchmarks(std::cout, config.bench_baseline);
+    }
+
     if (config.print_usage || config.input_path.empty()) {
         std::cout << USAGE;
         return EXIT_SUCCESS;
     }
 
-    int w, h, n;
-    uint8_t* comps = stbi_load(config.input_path.data(), &w, &h, &n, sizeof(Color));
+    TraceSession trace_session(config.trace_path);
+
+    std::unique_ptr<PerfCounters> counters;
+    std::vector<PerfPhase> phases;
+
+    if (config.perf_counters) {
+        counters = std::make_unique<PerfCounters>();
+    }
+
+    const auto begin_phase = [&counters]() {
+        if (counters) {
+            counters->start();
+        }
+    };
+
+    const auto end_phase = [&counters, &phases](std::string_view name, size_t pixel_count) {
+        if (counters) {
+            phases.push_back({ name, counters->stop(), pixel_count });
+        }
+    };
+
+    begin_phase();
+
+    trace_begin("load", "image", 0);
+
+    // Animated GIFs convert every frame, in parallel, and play them back or write them all
+    // out; stbi_load would only give the first.
+    GifFrames gif = load_gif_frames(config.input_path);
+    if (gif.pixels != nullptr && gif.count > 1) {
+        trace_end("load");
+
+        const auto width = static_cast<size_t>(gif.width);
+        const auto height = static_cast<size_t>(gif.height);
+        const auto count = static_cast<size_t>(gif.count);
+        end_phase("decode", width * height * count);
+
+        normalize_dimensions(config, width, height);
+        config.redraw_lines = config.output_path.empty();
+
+        begin_phase();
+        trace_begin("convert", "frames", gif.count);
+        const std::vector<std::string> frames = convert_frames(config, gif.pixels, count, width, height);
+        trace_end("convert");
+        end_phase("convert", width * height * count);
+        stbi_image_free(gif.pixels);
+
+        begin_phase();
+        trace_begin("write", "frames", gif.count);
+
+        if (config.output_path.empty()) {
+            play_frames(std::cout, frames, gif.delays);
+        } else {
+            std::ofstream file(config.output_path.data());
+            if (!file.is_open()) {
+                std::cerr << "Could not open " << config.output_path << '\n';
+                stbi_image_free(gif.delays);
+                return EXIT_FAILURE;
+            }
+
+            write_frames(file, frames, gif.delays);
+
+            file.close();
+            if (!file.good()) {
+                std::cerr << "Bad file: " << config.output_path << '\n';
+                stbi_image_free(gif.delays);
+                return EXIT_FAILURE;
+            }
+        }
+        stbi_image_free(gif.delays);
+
+        trace_end("write");
+        end_phase("output", width * height * count);
+
+        if (counters) {
+            print_perf_report(std::cerr, *counters, phases);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    // 16 bit and Radiance HDR sources are decoded at full precision and tone mapped down to
+    // 8 bits, keeping any alpha. When the render only needs plain mean cells, 8 bit grey sources
+    // are kept at one byte per pixel and sources with alpha at four, composited as the cells are
+    // averaged; anything else reads RGB, with alpha flattened first. stb expands palettes to
+    // RGB(A) itself. A single frame GIF was already decoded, to the RGBA that stbi_load would
+    // give it, and is used as it is.
+    const bool still_gif = gif.pixels != nullptr;
+    if (still_gif) {
+        stbi_image_free(gif.delays);
+    }
+
+    const bool hdr = !still_gif && stbi_is_hdr(config.input_path.data()) != 0;
+    const bool deep = !still_gif && !hdr && stbi_is_16_bit(config.input_path.data()) != 0;
+
+    int w = gif.width;
+    int h = gif.height;
+    int n = 4;
+    bool gray = false;
+    bool alpha = false;
+    bool rgba = false;
+    if(still_gif || stbi_info(config.input_path.data(), &w, &h, &n) != 0) {
+        normalize_dimensions(config, static_cast<size_t>(w), static_cast<size_t>(h));
+        const bool plane = plane_supported(config, static_cast<size_t>(w), static_cast<size_t>(h));
+        alpha = n == 2 || n == 4;
+        gray = n == 1 && plane && !hdr && !deep;
+        rgba = alpha && plane;
+    }
+
+    void* comps = nullptr;
+    if (still_gif) {
+        comps = gif.pixels;
+    } else if (hdr) {
+        comps = stbi_loadf(config.input_path.data(), &w, &h, &n, alpha ? 4 : 3);
+    } else if (deep) {
+        comps = stbi_load_16(config.input_path.data(), &w, &h, &n, alpha ? 4 : 3);
+    } else {
+        comps = stbi_load(config.input_path.data(), &w, &h, &n, gray ? 1 : alpha ? 4 : sizeof(Color));
+    }
+
+    trace_end("load");
 
     if (comps == nullptr) {
         std::cerr << "Failed to load " << config.input_path << '\n';
@@ -308,39 +694,113 @@ int main(int args, char* argv[])
     auto height = static_cast<size_t>(h);
 
     size_t length = width * height;
-    auto pixels { std::make_unique<Color>(length) };
-    memcpy(pixels.get(), comps, length * sizeof(Color));
+    trace_begin(hdr || deep ? "tone map" : "copy", "image", 0);
+
+    std::unique_ptr<Color[]> pixels;
+    std::unique_ptr<uint8_t[]> plane_pixels;
+    std::vector<uint8_t> visible;
+    if ((hdr || deep) && alpha) {
+        auto mapped = hdr ? tone_map_float_rgba(config, static_cast<const float*>(comps), length)
+            : tone_map_16_rgba(config, static_cast<const uint16_t*>(comps), length);
+        if (rgba) {
+            plane_pixels = std::move(mapped);
+        } else {
+            pixels = flatten_alpha(config, mapped.get(), length, visible);
+        }
+    } else if (hdr) {
+        pixels = tone_map_float(config, static_cast<const float*>(comps), length);
+    } else if (deep) {
+        pixels = tone_map_16(config, static_cast<const uint16_t*>(comps), length);
+    } else if (gray || rgba) {
+        const size_t size = length * (rgba ? 4 : 1);
+        plane_pixels = std::make_unique<uint8_t[]>(size);
+        memcpy(plane_pixels.get(), comps, size);
+    } else if (alpha) {
+        pixels = flatten_alpha(config, static_cast<const uint8_t*>(comps), length, visible);
+    } else {
+        pixels = std::make_unique<Color[]>(length);
+        memcpy(pixels.get(), comps, length * sizeof(Color));
+    }
     stbi_image_free(comps);
 
-    //columns and rows normalization
-    if(config.cols == -1U && config.rows == -1U) {
-        config.cols = static_cast<uint32_t>(width);
-        config.rows = static_cast<uint32_t>(height);
-    } else if(config.cols == -1U) {
-        double cols = static_cast<double>(config.rows) * static_cast<double>(width) / static_cast<double>(height);
-        config.cols = static_cast<uint32_t>(cols + 1); //Use Ceiling to cover leftover image
-    } else if(config.rows == -1U) {
-        double rows = static_cast<double>(config.cols) * static_cast<double>(height) / static_cast<double>(width);
-        config.rows = static_cast<uint32_t>(rows + 1); //Use Ceiling to cover leftover image
+    trace_end(hdr || deep ? "tone map" : "copy");
+
+    end_phase("decode", length);
+
+    normalize_dimensions(config, width, height);
+
+    begin_phase();
+
+    // Samples read by each coarse render are kept for the next one, down to the final render.
+    ProgressiveSampler sampler;
+    std::string previous;
+
+    if (progressive_refines(config)) {
+        config.redraw_lines = true;
+
+        // A level whose grid reaches half the cell reads about as much as the full render.
+        const double cell_size = std::min(static_cast<double>(width) / config.cols, static_cast<double>(height) / config.rows);
+
+        for (uint32_t level : PROGRESSIVE_LEVELS) {
+            if ((config.quality != 0 && level >= config.quality) || static_cast<double>(2u << level) > cell_size) {
+                break;
+            }
+
+            Configuration coarse = config;
+            coarse.quality = level;
+
+            std::string frame;
+            trace_begin("convert", "quality", level);
+            doAsciiConversion(coarse, frame, pixels, width, height, &sampler, visible.empty() ? nullptr : visible.data());
+            trace_end("convert");
+
+            write_over(std::cout, frame, previous);
+            std::cout.flush();
+            previous = std::move(frame);
+        }
     }
 
-    if(config.output_path.empty()) {
-        doAsciiConversion(config, std::cout, pixels, width, height);
-        return EXIT_SUCCESS;
+    std::string ascii;
+
+    trace_begin("convert", "image", 0);
+    if (gray) {
+        doGrayConversion(config, ascii, plane_pixels.get(), width, height);
+    } else if (rgba) {
+        doRgbaConversion(config, ascii, plane_pixels.get(), width, height);
+    } else {
+        doAsciiConversion(config, ascii, pixels, width, height, &sampler, visible.empty() ? nullptr : visible.data());
     }
+    trace_end("convert");
 
-    std::ofstream file(config.output_path.data());
-    if (!file.is_open()) {
-        std::cerr << "Could not open " << config.output_path << '\n';
-        return EXIT_FAILURE;
+    end_phase("convert", length);
+
+    begin_phase();
+    trace_begin("write", "image", 0);
+
+    if(config.output_path.empty()) {
+        write_over(std::cout, ascii, previous);
+        std::cout.flush();
+    } else {
+        std::ofstream file(config.output_path.data());
+        if (!file.is_open()) {
+            std::cerr << "Could not open " << config.output_path << '\n';
+            return EXIT_FAILURE;
+        }
+
+        file.write(ascii.data(), static_cast<std::streamsize>(ascii.size()));
+
+        file.close();
+        if (!file.good()) {
+            std::cerr << "Bad file: " << config.output_path << '\n';
+            return EXIT_FAILURE;
+        }
     }
 
-    doAsciiConversion(config, file, pixels, width, height);
+    trace_end("write");
+    end_phase("output", length);
 
-    file.close();
-    if (!file.good()) {
-        std::cerr << "Bad file: " << config.output_path << '\n';
-        return EXIT_FAILURE;
+    if (counters) {
+        print_perf_report(std::cerr, *counters, phases);
     }
 
     return EXIT_SUCCESS;
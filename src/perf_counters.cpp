@@ -0,0 +1,212 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "perf_counters.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static constexpr std::array<std::string_view, PERF_EVENT_COUNT> EVENT_NAMES { "cycles", "instructions", "cache-misses", "branch-misses" };
+
+#if defined(__linux__)
+static constexpr std::array<uint64_t, PERF_EVENT_COUNT> EVENT_CONFIGS {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int open_event(uint64_t config)
+{
+    perf_event_attr attr { };
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Also count the threads started while the counter is open (the equalize and frame pools).
+    // Their counts fold into this one as they exit, which RESET does not clear, so phases are
+    // measured as the difference of two reads.
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// value, time enabled, time running
+static bool read_event(int fd, std::array<uint64_t, 3>& data)
+{
+    return read(fd, data.data(), sizeof(data)) == static_cast<ssize_t>(sizeof(data));
+}
+#endif
+
+PerfCounters::PerfCounters()
+{
+    fds.fill(-1);
+
+#if defined(__linux__)
+    for(size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        fds[i] = open_event(EVENT_CONFIGS[i]);
+
+        if(fds[i] < 0 && reason.empty()) {
+            reason = std::string(EVENT_NAMES[i]) + ": " + strerror(errno);
+        }
+    }
+#else
+    reason = "perf_event_open is only available on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+    for(int fd : fds) {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::available() const
+{
+    for(int fd : fds) {
+        if(fd >= 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PerfCounters::start()
+{
+#if defined(__linux__)
+    for(size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if(fds[i] >= 0) {
+            read_event(fds[i], baseline[i]);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+
+    started = std::chrono::steady_clock::now();
+}
+
+PerfSample PerfCounters::stop()
+{
+    PerfSample sample;
+    sample.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+
+#if defined(__linux__)
+    for(size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if(fds[i] < 0) {
+            continue;
+        }
+
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        std::array<uint64_t, 3> data { };
+        if(!read_event(fds[i], data)) {
+            continue;
+        }
+
+        for(size_t field = 0; field < data.size(); field++) {
+            data[field] -= baseline[i][field];
+        }
+
+        if(data[2] == 0) {
+            continue;
+        }
+
+        // The PMU may multiplex events when there are more than it has registers for,
+        // scale back up to the whole enabled window.
+        if(data[2] < data[1]) {
+            data[0] = static_cast<uint64_t>(static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]));
+        }
+
+        sample.values[i] = data[0];
+        sample.valid[i] = true;
+    }
+#endif
+
+    return sample;
+}
+
+void print_perf_report(std::ostream& out, const PerfCounters& counters, const std::vector<PerfPhase>& phases)
+{
+    if(!counters.available()) {
+        out << "Hardware counters unavailable (" << counters.unavailable_reason() << "), reporting wall time only.\n";
+    }
+
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+
+    out << std::left << std::setw(10) << "phase" << std::right << std::setw(12) << "time(ms)";
+    for(std::string_view name : EVENT_NAMES) {
+        out << std::setw(16) << name;
+    }
+    out << std::setw(8) << "IPC" << std::setw(12) << "cycles/px" << std::setw(12) << "instr/px" << std::setw(12) << "cmiss/kpx" << std::setw(12) << "bmiss/kpx" << '\n';
+
+    for(const PerfPhase& phase : phases) {
+        const PerfSample& sample = phase.sample;
+        const auto pixels = static_cast<double>(phase.pixel_count == 0 ? 1 : phase.pixel_count);
+
+        out << std::left << std::setw(10) << phase.name << std::right << std::fixed << std::setprecision(3) << std::setw(12) << sample.wall_ms;
+
+        for(size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+            if(sample.valid[i]) {
+                out << std::setw(16) << sample.values[i];
+            } else {
+                out << std::setw(16) << "-";
+            }
+        }
+
+        out << std::setprecision(2);
+
+        if(sample.has(PerfEvent::CYCLES) && sample.has(PerfEvent::INSTRUCTIONS) && sample[PerfEvent::CYCLES] != 0) {
+            out << std::setw(8) << static_cast<double>(sample[PerfEvent::INSTRUCTIONS]) / static_cast<double>(sample[PerfEvent::CYCLES]);
+        } else {
+            out << std::setw(8) << "-";
+        }
+
+        const auto per_pixel = [&](PerfEvent event, double scale) {
+            if(sample.has(event)) {
+                out << std::setw(12) << static_cast<double>(sample[event]) * scale / pixels;
+            } else {
+                out << std::setw(12) << "-";
+            }
+        };
+
+        per_pixel(PerfEvent::CYCLES, 1);
+        per_pixel(PerfEvent::INSTRUCTIONS, 1);
+        per_pixel(PerfEvent::CACHE_MISSES, 1000);
+        per_pixel(PerfEvent::BRANCH_MISSES, 1000);
+        out << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
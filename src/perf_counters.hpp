@@ -0,0 +1,81 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class PerfEvent : size_t
+{
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    COUNT
+};
+
+static constexpr size_t PERF_EVENT_COUNT = static_cast<size_t>(PerfEvent::COUNT);
+
+struct PerfSample
+{
+    std::array<uint64_t, PERF_EVENT_COUNT> values { };
+    std::array<bool, PERF_EVENT_COUNT> valid { };
+    double wall_ms = 0;
+
+    uint64_t operator[](PerfEvent event) const { return values[static_cast<size_t>(event)]; }
+    bool has(PerfEvent event) const { return valid[static_cast<size_t>(event)]; }
+};
+
+struct PerfPhase
+{
+    std::string_view name;
+    PerfSample sample;
+    size_t pixel_count;
+};
+
+// Counts hardware events for the calling thread and the threads it starts (user space only)
+// via perf_event_open.
+// Each event is opened on its own so a PMU that lacks e.g. cache-miss support still reports
+// the rest; when nothing can be opened (containers, non-Linux) only wall time is collected.
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    const std::string& unavailable_reason() const { return reason; }
+
+    void start();
+    PerfSample stop();
+
+private:
+    std::array<int, PERF_EVENT_COUNT> fds;
+    std::array<std::array<uint64_t, 3>, PERF_EVENT_COUNT> baseline { };
+    std::chrono::steady_clock::time_point started;
+    std::string reason;
+};
+
+void print_perf_report(std::ostream& out, const PerfCounters& counters, const std::vector<PerfPhase>& phases);
@@ -0,0 +1,79 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "progressive.hpp"
+
+#include "luma.hpp"
+
+void ProgressiveSampler::refine(const Configuration& config, const Color* pixels, size_t img_width, const CellSpans& column_spans, const CellSpans& row_spans, uint32_t level)
+{
+    const size_t cells = column_spans.size() * row_spans.size();
+    if(cells != sums.size() || column_spans.size() != columns) {
+        columns = column_spans.size();
+        levels_read = 0;
+        sums.assign(cells, { });
+        cell_luminance.assign(cells, 0);
+        cell_colors.assign(cells, { });
+    }
+
+    if(levels_read > level) {
+        return;
+    }
+
+    for(size_t row = 0; row < row_spans.size(); row++) {
+        for(size_t col = 0; col < columns; col++) {
+            const SampleRegion cell { column_spans.begin[col], row_spans.begin[row], column_spans.end[col], row_spans.end[row] };
+            if(cell.right == cell.left || cell.bottom == cell.top) {
+                continue;
+            }
+
+            CellSums& cell_sums = sums[row * columns + col];
+            for(uint32_t l = levels_read; l <= level; l++) {
+                visit_new_samples(cell, l, img_width, [&](size_t offset) {
+                    const Color& pixel = pixels[offset];
+
+                    if(config.linear) {
+                        cell_sums.channels[0] += SRGB_TO_LINEAR[pixel.red];
+                        cell_sums.channels[1] += SRGB_TO_LINEAR[pixel.green];
+                        cell_sums.channels[2] += SRGB_TO_LINEAR[pixel.blue];
+                    } else {
+                        cell_sums.luma += configured_luma(config, pixel);
+                        cell_sums.channels[0] += pixel.red;
+                        cell_sums.channels[1] += pixel.green;
+                        cell_sums.channels[2] += pixel.blue;
+                    }
+
+                    cell_sums.count++;
+                });
+            }
+
+            const uint64_t count = cell_sums.count;
+            if(config.linear) {
+                cell_colors[row * columns + col] = linear_mean(cell_sums.channels, count);
+                cell_luminance[row * columns + col] = configured_luma(config, cell_colors[row * columns + col]);
+            } else {
+                cell_colors[row * columns + col] = {
+                    static_cast<uint8_t>((cell_sums.channels[0] + count / 2) / count),
+                    static_cast<uint8_t>((cell_sums.channels[1] + count / 2) / count),
+                    static_cast<uint8_t>((cell_sums.channels[2] + count / 2) / count),
+                };
+                cell_luminance[row * columns + col] = cell_sums.luma / static_cast<double>(count);
+            }
+        }
+    }
+
+    levels_read = level + 1;
+}
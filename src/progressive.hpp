@@ -0,0 +1,154 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Nested stratified sampling, for --quality and --progressive. Level l cuts a cell into a
+// 2^l x 2^l grid of strata (strata that round down to no pixels are dropped) and reads one
+// pixel at a random looking spot in each. Every stratum of level l + 1 is a quarter of one of
+// level l, and the quarter holding its parent's pixel keeps that pixel, so each level's
+// samples contain the previous level's and refining a cell only reads the new ones. A cell no
+// larger than the grid has single pixel strata and is read exactly.
+
+struct SampleRegion
+{
+    size_t left;
+    size_t top;
+    size_t right;
+    size_t bottom;
+};
+
+// Integer hash of a stratum's corner and level, so the jitter is the same every run.
+constexpr uint32_t sample_hash(size_t x, size_t y, uint32_t level)
+{
+    uint32_t hash = static_cast<uint32_t>(x) * 0x9E3779B1u ^ static_cast<uint32_t>(y) * 0x85EBCA77u ^ level * 0xC2B2AE3Du;
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+// Stratum (sx, sy) of `cell` on level `level`; empty when it rounds down to no pixels.
+constexpr SampleRegion sample_stratum(const SampleRegion& cell, uint32_t level, size_t sx, size_t sy)
+{
+    const size_t width = cell.right - cell.left;
+    const size_t height = cell.bottom - cell.top;
+
+    return {
+        cell.left + (width * sx >> level),
+        cell.top + (height * sy >> level),
+        cell.left + (width * (sx + 1) >> level),
+        cell.top + (height * (sy + 1) >> level),
+    };
+}
+
+// The pixel stratum (sx, sy) of `level` reads, walking down from the whole cell so that
+// every level keeps its parent's pixel when it falls inside. Returns x + y * stride.
+constexpr size_t sample_offset(const SampleRegion& cell, uint32_t level, size_t sx, size_t sy, size_t stride)
+{
+    size_t x = 0;
+    size_t y = 0;
+
+    for(uint32_t l = 0; l <= level; l++) {
+        const SampleRegion stratum = sample_stratum(cell, l, sx >> (level - l), sy >> (level - l));
+        if(l != 0 && x >= stratum.left && x < stratum.right && y >= stratum.top && y < stratum.bottom) {
+            continue;
+        }
+
+        const uint32_t hash = sample_hash(stratum.left, stratum.top, l);
+        x = stratum.left + (hash & 0xFFFF) % (stratum.right - stratum.left);
+        y = stratum.top + (hash >> 16) % (stratum.bottom - stratum.top);
+    }
+
+    return x + y * stride;
+}
+
+// Calls visit(offset) for every pixel `level` reads that level - 1 did not (for level 0, the
+// cell's single sample). A stratum that loses its parent's pixel reads a fresh one, so only the
+// parents are walked down from the whole cell. `cell` must not be empty.
+template<typename Visit>
+void visit_new_samples(const SampleRegion& cell, uint32_t level, size_t stride, Visit visit)
+{
+    if(level == 0) {
+        visit(sample_offset(cell, 0, 0, 0, stride));
+        return;
+    }
+
+    const size_t parents = size_t { 1 } << (level - 1);
+
+    for(size_t py = 0; py < parents; py++) {
+        for(size_t px = 0; px < parents; px++) {
+            const SampleRegion parent = sample_stratum(cell, level - 1, px, py);
+            if(parent.right == parent.left || parent.bottom == parent.top) {
+                continue;
+            }
+
+            const size_t inherited = sample_offset(cell, level - 1, px, py, stride);
+            const size_t inherited_x = inherited % stride;
+            const size_t inherited_y = inherited / stride;
+
+            for(size_t sy = py * 2; sy < py * 2 + 2; sy++) {
+                for(size_t sx = px * 2; sx < px * 2 + 2; sx++) {
+                    const SampleRegion stratum = sample_stratum(cell, level, sx, sy);
+                    if(stratum.right == stratum.left || stratum.bottom == stratum.top) {
+                        continue;
+                    }
+
+                    if(inherited_x >= stratum.left && inherited_x < stratum.right && inherited_y >= stratum.top && inherited_y < stratum.bottom) {
+                        continue;
+                    }
+
+                    const uint32_t hash = sample_hash(stratum.left, stratum.top, level);
+                    const size_t x = stratum.left + (hash & 0xFFFF) % (stratum.right - stratum.left);
+                    const size_t y = stratum.top + (hash >> 16) % (stratum.bottom - stratum.top);
+                    visit(x + y * stride);
+                }
+            }
+        }
+    }
+}
+
+// Per cell sample sums kept between renders, so each --progressive pass only reads the
+// samples its level adds. Mean reducer only.
+class ProgressiveSampler
+{
+public:
+    // Brings every cell up to `level`. Starts over if the cell grid changed.
+    void refine(const Configuration& config, const Color* pixels, size_t img_width, const CellSpans& columns, const CellSpans& rows, uint32_t level);
+
+    double luminance(size_t row, size_t col) const { return cell_luminance[row * columns + col]; }
+    Color color(size_t row, size_t col) const { return cell_colors[row * columns + col]; }
+
+private:
+    struct CellSums
+    {
+        double luma = 0;
+        uint64_t channels[3] { };
+        uint64_t count = 0;
+    };
+
+    size_t columns = 0;
+    uint32_t levels_read = 0;
+
+    std::vector<CellSums> sums;
+    std::vector<double> cell_luminance;
+    std::vector<Color> cell_colors;
+};
@@ -0,0 +1,69 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "reducers.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LumaRanker::LumaRanker(const Configuration& config)
+    : reducer(config.reducer),
+      percentile(std::clamp(config.reducer == CellReducer::MEDIAN ? 50.0 : config.percentile, 0.0, 100.0)),
+      ranked(config.reducer == CellReducer::MEDIAN || config.reducer == CellReducer::PERCENTILE)
+{
+}
+
+double LumaRanker::take()
+{
+    if(low > high) {
+        return 0;
+    }
+
+    uint8_t level = 0;
+
+    if(reducer == CellReducer::MIN) {
+        level = low;
+    } else if(reducer == CellReducer::MAX) {
+        level = high;
+    } else {
+        // Nearest rank, 0-based.
+        const auto rank = static_cast<uint32_t>(std::lround(percentile / 100 * static_cast<double>(levels.size() - 1)));
+
+        uint32_t seen = 0;
+        size_t block = 0;
+        while(seen + coarse[block] <= rank) {
+            seen += coarse[block++];
+        }
+
+        size_t bin = block << COARSE_SHIFT;
+        while(seen + fine[bin] <= rank) {
+            seen += fine[bin++];
+        }
+
+        level = static_cast<uint8_t>(bin);
+
+        for(uint8_t removed : levels) {
+            fine[removed]--;
+            coarse[removed >> COARSE_SHIFT]--;
+        }
+        levels.clear();
+    }
+
+    low = UINT8_MAX;
+    high = 0;
+
+    return static_cast<double>(level) / 255;
+}
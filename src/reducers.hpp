@@ -0,0 +1,64 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Order statistics of one cell's 8 bit luma levels. Levels go into a 256-bin histogram with a
+// 16-bin coarse level on top, so finding a rank scans at most 16 + 16 bins. Each cell fills the
+// histogram from empty; take() empties it again by undoing the levels the cell added, which
+// costs one decrement per pixel instead of a 256-bin wipe per cell. Min and max skip the
+// histogram and are tracked directly.
+class LumaRanker
+{
+public:
+    explicit LumaRanker(const Configuration& config);
+
+    void add(uint8_t level)
+    {
+        low = std::min(low, level);
+        high = std::max(high, level);
+
+        if(ranked) {
+            fine[level]++;
+            coarse[level >> COARSE_SHIFT]++;
+            levels.push_back(level);
+        }
+    }
+
+    // Luma (0-1) at the configured rank of the levels added since the last call.
+    double take();
+
+private:
+    static constexpr size_t COARSE_SHIFT = 4;
+
+    CellReducer reducer;
+    double percentile;
+    bool ranked;
+
+    uint8_t low = UINT8_MAX;
+    uint8_t high = 0;
+    std::array<uint32_t, 256> fine { };
+    std::array<uint32_t, (256 >> COARSE_SHIFT)> coarse { };
+    std::vector<uint8_t> levels;
+};
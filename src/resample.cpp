@@ -0,0 +1,201 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "resample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "edges.hpp"
+#include "luma.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+static constexpr double LANCZOS_LOBES = 3;
+
+static double sinc(double x)
+{
+    if(std::abs(x) < 1e-8) {
+        return 1;
+    }
+
+    const double angle = std::numbers::pi * x;
+    return std::sin(angle) / angle;
+}
+
+// Support radius and kernel, in units of one cell.
+static double filter_support(ResampleFilter filter)
+{
+    switch(filter) {
+        case ResampleFilter::BILINEAR: return 1;
+        case ResampleFilter::GAUSSIAN: return 1.5;
+        case ResampleFilter::LANCZOS: return LANCZOS_LOBES;
+        default: return 0.5;
+    }
+}
+
+static double filter_weight(ResampleFilter filter, double x)
+{
+    switch(filter) {
+        case ResampleFilter::BILINEAR: return std::max(0.0, 1 - std::abs(x));
+        // sigma of half a cell
+        case ResampleFilter::GAUSSIAN: return std::exp(-2 * x * x);
+        case ResampleFilter::LANCZOS: return std::abs(x) < LANCZOS_LOBES ? sinc(x) * sinc(x / LANCZOS_LOBES) : 0;
+        default: return 1;
+    }
+}
+
+FilterTable filter_table(ResampleFilter filter, size_t extent, double cell_size)
+{
+    FilterTable table;
+    table.offset.push_back(0);
+
+    const auto last = static_cast<double>(extent);
+    // Kernels are scaled to the cell when downscaling and stay one sample wide when upscaling.
+    const double scale = std::max(cell_size, 1.0);
+
+    for(double start = 0; start < last; start += cell_size) {
+        const double end = std::min(last, start + cell_size);
+
+        double from;
+        double to;
+        if(filter == ResampleFilter::AREA) {
+            from = start;
+            to = end;
+        } else {
+            const double centre = (start + end) / 2;
+            const double reach = filter_support(filter) * scale;
+            from = std::max(0.0, centre - reach);
+            to = std::min(last, centre + reach);
+        }
+
+        const auto first = static_cast<size_t>(from);
+        const size_t stop = std::min(extent, static_cast<size_t>(std::ceil(to)));
+
+        double total = 0;
+        const size_t begin = table.weights.size();
+
+        for(size_t p = first; p < std::max(stop, first + 1); p++) {
+            double weight;
+            if(filter == ResampleFilter::AREA) {
+                weight = std::min(end, static_cast<double>(p + 1)) - std::max(start, static_cast<double>(p));
+            } else {
+                weight = filter_weight(filter, (static_cast<double>(p) + 0.5 - (start + end) / 2) / scale);
+            }
+
+            table.weights.push_back(static_cast<float>(weight));
+            total += weight;
+        }
+
+        if(total != 0) {
+            for(size_t i = begin; i < table.weights.size(); i++) {
+                table.weights[i] = static_cast<float>(static_cast<double>(table.weights[i]) / total);
+            }
+        }
+
+        table.first.push_back(first);
+        table.offset.push_back(table.weights.size());
+    }
+
+    return table;
+}
+
+// Dot product of `count` source values with their weights.
+static float dot(const float* values, const float* weights, size_t count)
+{
+    Float4 sums = Float4::broadcast(0);
+    size_t i = 0;
+
+    for(; i + Float4::WIDTH <= count; i += Float4::WIDTH) {
+        sums += Float4::load(values + i) * Float4::load(weights + i);
+    }
+
+    float lanes[Float4::WIDTH];
+    sums.store(lanes);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    for(; i < count; i++) {
+        sum += values[i] * weights[i];
+    }
+
+    return sum;
+}
+
+std::vector<float> resampled_cells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, double quad_width, double quad_height)
+{
+    TraceScope scope("resample");
+
+    const FilterTable horizontal = filter_table(config.filter, img_width, quad_width);
+    const FilterTable vertical = filter_table(config.filter, img_height, quad_height);
+
+    const size_t columns = horizontal.size();
+    std::vector<float> cells(columns * vertical.size(), 0.0f);
+
+    std::vector<float> luma(img_width);
+    std::vector<float> reduced(columns);
+
+    // Cell rows whose taps can still include the current source row; `first` only grows.
+    size_t lowest = 0;
+
+    for(size_t y = 0; y < img_height; y++) {
+        while(lowest < vertical.size() && vertical.first[lowest] + vertical.count(lowest) <= y) {
+            lowest++;
+        }
+
+        if(lowest == vertical.size()) {
+            break;
+        }
+
+        if(vertical.first[lowest] > y) {
+            continue;
+        }
+
+        load_luma(config, pixels.get() + y * img_width, img_width, luma.data());
+
+        for(size_t c = 0; c < columns; c++) {
+            reduced[c] = dot(luma.data() + horizontal.first[c], horizontal.weights.data() + horizontal.offset[c], horizontal.count(c));
+        }
+
+        for(size_t r = lowest; r < vertical.size() && vertical.first[r] <= y; r++) {
+            if(y >= vertical.first[r] + vertical.count(r)) {
+                continue;
+            }
+
+            const Float4 weight = Float4::broadcast(vertical.weights[vertical.offset[r] + (y - vertical.first[r])]);
+            float* row = cells.data() + r * columns;
+
+            size_t c = 0;
+            for(; c + Float4::WIDTH <= columns; c += Float4::WIDTH) {
+                (Float4::load(row + c) + weight * Float4::load(reduced.data() + c)).store(row + c);
+            }
+
+            for(; c < columns; c++) {
+                row[c] += vertical.weights[vertical.offset[r] + (y - vertical.first[r])] * reduced[c];
+            }
+        }
+    }
+
+    // Lanczos overshoots around sharp edges.
+    for(float& cell : cells) {
+        cell = std::clamp(cell, 0.0f, 1.0f);
+        if(config.linear) {
+            cell = encode_linear_luma(cell);
+        }
+    }
+
+    return cells;
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Weights of every output sample along one axis. Output i reads the source samples
+// [first[i], first[i] + count(i)) with weights[offset[i]...], which sum to 1.
+struct FilterTable
+{
+    std::vector<size_t> first;
+    std::vector<size_t> offset;
+    std::vector<float> weights;
+
+    size_t size() const { return first.size(); }
+    size_t count(size_t i) const { return offset[i + 1] - offset[i]; }
+};
+
+// One entry per cell of `cell_size` source samples, stepping like cell_spans. AREA weighs each
+// sample by how much of it the cell covers, so boundary samples count in part; the other
+// filters are centred on the cell and stretched to its size when downscaling.
+FilterTable filter_table(ResampleFilter filter, size_t extent, double cell_size);
+
+// Mean luma of every cell, row major, through `config.filter`. Separable and row-streamed:
+// each source row is reduced horizontally into one value per column, and that row of column
+// values is added into every cell row whose vertical taps include it. Under -l the luma is
+// filtered in linear light and each cell re-encoded.
+std::vector<float> resampled_cells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, double quad_width, double quad_height);
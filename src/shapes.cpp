@@ -0,0 +1,123 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "shapes.hpp"
+
+#include <algorithm>
+
+#include "glyph_font.hpp"
+
+// Terminal cell the font is laid out in: one column of spacing on the right, one row of
+// leading above and one below the descenders. Sub-cells are CELL / SHAPE pixels on a side.
+static constexpr size_t CELL_WIDTH = 6;
+static constexpr size_t CELL_HEIGHT = 10;
+static constexpr size_t FONT_TOP = 1;
+
+static_assert(CELL_WIDTH % SHAPE_COLS == 0 && CELL_HEIGHT % SHAPE_ROWS == 0, "sub-cells must cover whole font pixels");
+
+static constexpr size_t SUB_WIDTH = CELL_WIDTH / SHAPE_COLS;
+static constexpr size_t SUB_HEIGHT = CELL_HEIGHT / SHAPE_ROWS;
+
+static constexpr uint32_t SIGNATURE_LEVELS = 4;
+static constexpr uint32_t SIGNATURE_BITS = 2;
+
+using Coverage = std::array<uint8_t, SHAPE_SAMPLES>;
+
+static constexpr bool inked(const GlyphBitmap& bitmap, size_t x, size_t y)
+{
+    if(x >= GLYPH_FONT_WIDTH || y < FONT_TOP || y - FONT_TOP >= GLYPH_FONT_HEIGHT) {
+        return false;
+    }
+
+    return bitmap.rows[y - FONT_TOP][x] == '#';
+}
+
+// Fraction of each sub-cell covered by ink, 0-255.
+static constexpr std::array<Coverage, GLYPH_FONT.size()> build_coverage()
+{
+    std::array<Coverage, GLYPH_FONT.size()> coverage { };
+
+    for(size_t glyph = 0; glyph < GLYPH_FONT.size(); glyph++) {
+        for(size_t sub_y = 0; sub_y < SHAPE_ROWS; sub_y++) {
+            for(size_t sub_x = 0; sub_x < SHAPE_COLS; sub_x++) {
+                size_t ink = 0;
+
+                for(size_t y = sub_y * SUB_HEIGHT; y < (sub_y + 1) * SUB_HEIGHT; y++) {
+                    for(size_t x = sub_x * SUB_WIDTH; x < (sub_x + 1) * SUB_WIDTH; x++) {
+                        if(inked(GLYPH_FONT[glyph], x, y)) {
+                            ink++;
+                        }
+                    }
+                }
+
+                coverage[glyph][sub_y * SHAPE_COLS + sub_x] = static_cast<uint8_t>(ink * 255 / (SUB_WIDTH * SUB_HEIGHT));
+            }
+        }
+    }
+
+    return coverage;
+}
+
+static constexpr auto GLYPH_COVERAGE = build_coverage();
+
+// Level centres of the quantized signature on the same 0-255 scale as GLYPH_COVERAGE.
+static constexpr int level_value(uint32_t level)
+{
+    return static_cast<int>((2 * level + 1) * 255 / (2 * SIGNATURE_LEVELS));
+}
+
+static char nearest_glyph(uint32_t signature)
+{
+    size_t best = 0;
+    int best_distance = -1;
+
+    for(size_t glyph = 0; glyph < GLYPH_COVERAGE.size(); glyph++) {
+        int distance = 0;
+
+        for(size_t i = 0; i < SHAPE_SAMPLES; i++) {
+            const int level = level_value((signature >> (SIGNATURE_BITS * i)) & (SIGNATURE_LEVELS - 1));
+            const int delta = level - GLYPH_COVERAGE[glyph][i];
+            distance += delta * delta;
+        }
+
+        if(best_distance < 0 || distance < best_distance) {
+            best = glyph;
+            best_distance = distance;
+        }
+    }
+
+    return GLYPH_FONT[best].glyph;
+}
+
+char ShapeMatcher::match(const std::array<double, SHAPE_SAMPLES>& ink)
+{
+    uint32_t signature = 0;
+
+    for(size_t i = 0; i < SHAPE_SAMPLES; i++) {
+        const auto level = static_cast<uint32_t>(std::clamp(ink[i] * SIGNATURE_LEVELS, 0.0, static_cast<double>(SIGNATURE_LEVELS - 1)));
+        signature |= level << (SIGNATURE_BITS * i);
+    }
+
+    const auto cached = cache.find(signature);
+    if(cached != cache.end()) {
+        return cached->second;
+    }
+
+    const char glyph = nearest_glyph(signature);
+    cache.emplace(signature, glyph);
+
+    return glyph;
+}
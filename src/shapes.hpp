@@ -0,0 +1,41 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Each cell is sampled as a grid of SHAPE_COLS x SHAPE_ROWS sub-cells.
+static constexpr size_t SHAPE_COLS = 3;
+static constexpr size_t SHAPE_ROWS = 5;
+static constexpr size_t SHAPE_SAMPLES = SHAPE_COLS * SHAPE_ROWS;
+
+// Picks the printable ASCII glyph whose ink layout is closest to a cell's. Glyph coverage
+// vectors are computed at compile time from the embedded bitmap font. Cells are quantized to
+// a 2 bit per sub-cell signature and each signature is only searched for once, so matching is
+// a hash lookup for all but the first cell with a given shape.
+class ShapeMatcher
+{
+public:
+    // `ink` is SHAPE_ROWS x SHAPE_COLS values in [0, 1], row major.
+    char match(const std::array<double, SHAPE_SAMPLES>& ink);
+
+private:
+    std::unordered_map<uint32_t, char> cache;
+};
@@ -0,0 +1,251 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "sharpen.hpp"
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+
+#include "edges.hpp"
+#include "luma.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+// Slides the vertical box sums of a row down COUNT rows, one row's vertical += entering[j] -
+// leaving[j] after another, leaving in totals[j] the running total of the sums after step j,
+// padded with `radius` copies of each end, so a horizontal box sum of radius `radius` is
+// totals[j][x + 2 * radius + 1] - totals[j][x]. Each of `totals` holds width + 2 * radius + 1
+// floats.
+template<size_t COUNT>
+static void slide_totals(float* vertical, const std::array<const float*, COUNT>& entering, const std::array<const float*, COUNT>& leaving, size_t width, size_t radius, const std::array<float*, COUNT>& totals)
+{
+    // The padding repeats the first and last sums of each step, worked out here in the same
+    // order the lanes below work them out.
+    float first = vertical[0];
+    float last = vertical[width - 1];
+    std::array<float, COUNT> carry { };
+    std::array<float, COUNT> lasts { };
+    for(size_t j = 0; j < COUNT; j++) {
+        first = first + entering[j][0] - leaving[j][0];
+        last = last + entering[j][width - 1] - leaving[j][width - 1];
+        lasts[j] = last;
+
+        totals[j][0] = 0;
+        for(size_t k = 1; k <= radius; k++) {
+            totals[j][k] = static_cast<float>(k) * first;
+        }
+
+        carry[j] = totals[j][radius];
+    }
+
+    const auto slide = [&](size_t x, auto lane, auto&& take) {
+        using Lane = decltype(lane);
+
+        Lane sums = Lane::load(vertical + x);
+        for(size_t j = 0; j < COUNT; j++) {
+            sums = sums + Lane::load(entering[j] + x) - Lane::load(leaving[j] + x);
+            take(j, prefix_sum(sums));
+        }
+
+        sums.store(vertical + x);
+    };
+
+    // Sixteen floats a step, so the carry from one step to the next is a single add that the
+    // scans within a step overlap with.
+    size_t x = 0;
+    for(; x + 4 * Float4::WIDTH <= width; x += 4 * Float4::WIDTH) {
+        std::array<std::array<Float4, 4>, COUNT> runs;
+        for(size_t i = 0; i < 4; i++) {
+            slide(x + i * Float4::WIDTH, Float4 { }, [&](size_t j, Float4 run) { runs[j][i] = run; });
+        }
+
+        for(size_t j = 0; j < COUNT; j++) {
+            for(size_t i = 1; i < 4; i++) {
+                runs[j][i] = runs[j][i] + spread_last(runs[j][i - 1]);
+            }
+
+            const Float4 base = Float4::broadcast(carry[j]);
+            for(size_t i = 0; i < 4; i++) {
+                (runs[j][i] + base).store(totals[j] + radius + 1 + x + i * Float4::WIDTH);
+            }
+
+            carry[j] = last_lane(base + spread_last(runs[j][3]));
+        }
+    }
+
+    for(; x < width; x++) {
+        slide(x, Float1 { }, [&](size_t j, Float1 run) {
+            carry[j] += last_lane(run);
+            totals[j][radius + 1 + x] = carry[j];
+        });
+    }
+
+    for(size_t j = 0; j < COUNT; j++) {
+        for(size_t k = radius + width + 1; k <= width + 2 * radius; k++) {
+            totals[j][k] = totals[j][k - 1] + lasts[j];
+        }
+    }
+}
+
+// Sharpened cells over a luma plane of `width` x `height`, `load_row(y, out)` filling row y.
+template<typename LoadRow>
+static void plane_sharpened_cells(const Configuration& config, size_t width, size_t height, const CellSpans& columns, const CellSpans& rows, size_t radius_x, size_t radius_y, LoadRow&& load_row, std::vector<float>& cells)
+{
+    const auto last_row = static_cast<int64_t>(height) - 1;
+
+    // The vertical box of row y spans rows y - radius_y to y + radius_y, and moving it down
+    // drops the row above that. Two rows are masked at a time, so 2 * radius_y + 3 rows are
+    // live; row j lives in slot j % ring. Row 0 is kept aside too, the top edge replicates it
+    // for longer than the ring holds it.
+    const size_t ring = 2 * radius_y + 3;
+    std::vector<float> luma(ring * width);
+    std::vector<float> first_luma(width);
+    std::vector<float> vertical(width, 0.0f);
+    std::vector<float> totals(2 * (width + 2 * radius_x + 1));
+    std::vector<float> column_sums(width, 0.0f);
+    std::vector<float> means(columns.size());
+
+    size_t loaded = 0;
+    const auto load_through = [&](int64_t y) {
+        for(; static_cast<int64_t>(loaded) <= std::min(y, last_row); loaded++) {
+            load_row(loaded, luma.data() + (loaded % ring) * width);
+
+            if(loaded == 0) {
+                std::copy_n(luma.data(), width, first_luma.data());
+            }
+        }
+    };
+
+    const auto luma_row = [&](int64_t y) -> const float* {
+        if(y <= 0) {
+            return first_luma.data();
+        }
+
+        return luma.data() + (static_cast<size_t>(std::min(y, last_row)) % ring) * width;
+    };
+
+    // Start one row above the top, so every row, the first included, slides the box down.
+    const auto reach = static_cast<int64_t>(radius_y);
+    load_through(reach - 1);
+    for(int64_t k = -reach - 1; k < reach; k++) {
+        const float* row = luma_row(k);
+        for_each_lane(0, width, [&](size_t x, auto lane) {
+            using Lane = decltype(lane);
+            (Lane::load(&vertical[x]) + Lane::load(&row[x])).store(&vertical[x]);
+        });
+    }
+
+    const auto amount = static_cast<float>(config.sharpen);
+    const float inverse_area = 1.0f / static_cast<float>((2 * radius_x + 1) * (2 * radius_y + 1));
+    const size_t span = 2 * radius_x + 1;
+
+    // Adds the masked luma of the `count` rows from y on to the column sums, the box slid down
+    // to each in one sweep and the sums read and written once for all of them.
+    const auto mask_rows = [&](size_t y, auto count) {
+        static constexpr size_t COUNT = decltype(count)::value;
+
+        std::array<const float*, COUNT> entering { };
+        std::array<const float*, COUNT> leaving { };
+        std::array<const float*, COUNT> centres { };
+        std::array<float*, COUNT> row_totals { };
+        for(size_t j = 0; j < COUNT; j++) {
+            const auto at = static_cast<int64_t>(y + j);
+            load_through(at + reach);
+            entering[j] = luma_row(at + reach);
+            leaving[j] = luma_row(at - reach - 1);
+            centres[j] = luma_row(at);
+            row_totals[j] = totals.data() + j * (width + 2 * radius_x + 1);
+        }
+
+        slide_totals<COUNT>(vertical.data(), entering, leaving, width, radius_x, row_totals);
+
+        for_each_lane(0, width, [&](size_t x, auto lane) {
+            using Lane = decltype(lane);
+
+            Lane sum = Lane::load(&column_sums[x]);
+            for(size_t j = 0; j < COUNT; j++) {
+                const Lane box = Lane::load(row_totals[j] + x + span) - Lane::load(row_totals[j] + x);
+                const Lane value = Lane::load(centres[j] + x);
+                sum = sum + min(max(value + Lane::broadcast(amount) * (value - box * Lane::broadcast(inverse_area)), Lane::broadcast(0)), Lane::broadcast(1));
+            }
+
+            sum.store(&column_sums[x]);
+        });
+    };
+
+    for(size_t r = 0; r < rows.size(); r++) {
+        // Cells smaller than a pixel share their row with the one before.
+        if(rows.repeats(r)) {
+            std::copy_n(cells.begin() + static_cast<ptrdiff_t>((r - 1) * columns.size()), columns.size(), cells.begin() + static_cast<ptrdiff_t>(r * columns.size()));
+            continue;
+        }
+
+        size_t y = rows.begin[r];
+        for(; y + 1 < rows.end[r]; y += 2) {
+            mask_rows(y, std::integral_constant<size_t, 2> { });
+        }
+
+        if(y < rows.end[r]) {
+            mask_rows(y, std::integral_constant<size_t, 1> { });
+        }
+
+        cell_means(columns, column_sums.data(), rows.end[r] - rows.begin[r], means.data());
+        if(config.linear) {
+            std::transform(means.begin(), means.end(), means.begin(), encode_linear_luma);
+        }
+
+        std::copy(means.begin(), means.end(), cells.begin() + static_cast<ptrdiff_t>(r * columns.size()));
+        std::fill(column_sums.begin(), column_sums.end(), 0.0f);
+    }
+}
+
+std::vector<float> sharpened_cells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& columns, const CellSpans& rows)
+{
+    TraceScope scope("sharpen");
+
+    std::vector<float> cells(columns.size() * rows.size(), 0.0f);
+    if(img_width == 0 || img_height == 0 || columns.size() == 0 || rows.size() == 0) {
+        return cells;
+    }
+
+    // The default radius, half a cell, is just as well half a cell of 2x2 bins, so large cells
+    // are masked on the binned plane. A radius given with --sharpen-radius is in pixels and is
+    // always honoured at full resolution.
+    const auto half_cell = [](size_t extent, size_t count) { return std::max<size_t>(1, extent / count / 2); };
+
+    if(config.sharpen_radius == 0 && binned_cells(columns, rows)) {
+        const size_t bin_width = (img_width + 1) / 2;
+        const size_t bin_height = (img_height + 1) / 2;
+
+        std::vector<float> scratch;
+        const auto load_row = [&](size_t y, float* out) {
+            const Color* top = pixels.get() + 2 * y * img_width;
+            const Color* bottom = pixels.get() + std::min(2 * y + 1, img_height - 1) * img_width;
+            load_binned_luma(config, top, bottom, img_width, out, scratch);
+        };
+
+        plane_sharpened_cells(config, bin_width, bin_height, binned_spans(columns), binned_spans(rows), half_cell(bin_width, columns.size()), half_cell(bin_height, rows.size()), load_row, cells);
+        return cells;
+    }
+
+    const size_t radius_x = config.sharpen_radius > 0 ? config.sharpen_radius : half_cell(img_width, columns.size());
+    const size_t radius_y = config.sharpen_radius > 0 ? config.sharpen_radius : half_cell(img_height, rows.size());
+
+    const auto load_row = [&](size_t y, float* out) { load_luma(config, pixels.get() + y * img_width, img_width, out); };
+    plane_sharpened_cells(config, img_width, img_height, columns, rows, radius_x, radius_y, load_row, cells);
+    return cells;
+}
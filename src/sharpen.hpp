@@ -0,0 +1,34 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Mean luma of every cell after unsharp masking the luma plane: l + amount * (l - box blur of
+// l), clamped to [0, 1]. One pass over the image, one source row at a time: each row's luma
+// is box blurred horizontally with a running sum, and the vertical box is a running sum of the
+// blurred rows held in a ring of 2 * radius + 3 rows, so the cost per pixel does not depend on
+// the radius. The vertical update, the mask and the per-column cell sums run four pixels at
+// a time. The blur radius defaults to half a cell, which brings out detail at the scale the
+// cells are able to show. With that default, cells at least 8 pixels each way are masked on
+// 2x2 bins of the image, a quarter of the work and finer than the cells show; a radius given
+// in pixels always runs at full resolution. Under -l the luma is masked in linear light and
+// each cell re-encoded.
+std::vector<float> sharpened_cells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& columns, const CellSpans& rows);
@@ -0,0 +1,234 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_TO_ASCII_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// min and max as minps and maxps compute them: `b` whenever either side is NaN, which
+// std::min and std::max do not (they return `a`). Every width agrees, so max(x, zero) takes
+// NaN to zero in vector bodies and scalar tails alike.
+inline float lane_min(float a, float b) { return a < b ? a : b; }
+inline float lane_max(float a, float b) { return a > b ? a : b; }
+
+// Four packed floats. Maps onto SSE2 where available (baseline on x86-64) and plain arrays
+// elsewhere, so kernels are written once and still build everywhere.
+struct Float4
+{
+    static constexpr size_t WIDTH = 4;
+
+#if defined(IMAGE_TO_ASCII_SSE2)
+    __m128 v;
+
+    static Float4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static Float4 broadcast(float x) { return { _mm_set1_ps(x) }; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    // Lanes 0, 3, 6, 9 / 1, 4, 7, 10 / 2, 5, 8, 11 of a, b, c taken together.
+    static void split_thirds(__m128 a, __m128 b, __m128 c, Float4& x, Float4& y, Float4& z)
+    {
+        x.v = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        y.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        z.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+    }
+
+    // Four packed 8 bit RGB pixels (12 bytes, nothing read past them) split into channels.
+    static void load_rgb(const uint8_t* p, Float4& red, Float4& green, Float4& blue)
+    {
+        int32_t tail;
+        std::memcpy(&tail, p + 8, sizeof(tail));
+        const __m128i bytes = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_cvtsi32_si128(tail));
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        const __m128 a = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));  // r0 g0 b0 r1
+        const __m128 b = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));  // g1 b1 r2 g2
+        const __m128 c = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)); // b2 r3 g3 b3
+
+        split_thirds(a, b, c, red, green, blue);
+    }
+
+    // Eight 2x2 bins of packed 8 bit RGB pixels, bin j holding pixels 2j and 2j + 1 of both
+    // `top` and `bottom` (16 pixels, 48 bytes, each) with their channels weighted by `weights`
+    // and added. Every step is an integer add or multiply, so as long as 4 * 255 times the
+    // weight total stays below 2^24 each lane is the exact sum.
+    static void load_weighted_bins(const uint8_t* top, const uint8_t* bottom, const int16_t (&weights)[3], Float4& low, Float4& high)
+    {
+        // The six vectors of 16 bit column sums hold 48 channels, and the weights repeat every
+        // three, so each vector starts one channel further on than the one before.
+        const __m128i starting_red = _mm_setr_epi16(weights[0], weights[1], weights[2], weights[0], weights[1], weights[2], weights[0], weights[1]);
+        const __m128i starting_blue = _mm_setr_epi16(weights[2], weights[0], weights[1], weights[2], weights[0], weights[1], weights[2], weights[0]);
+        const __m128i starting_green = _mm_setr_epi16(weights[1], weights[2], weights[0], weights[1], weights[2], weights[0], weights[1], weights[2]);
+
+        const __m128i zero = _mm_setzero_si128();
+        const auto upper = [&](size_t k) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 16 * k)); };
+        const auto lower = [&](size_t k) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 16 * k)); };
+
+        // Adjacent channels are multiplied and added in pairs, and bin j is pairs 3j to 3j + 2.
+        const auto low_half = [&](__m128i a, __m128i b, __m128i lane_weights) {
+            return _mm_cvtepi32_ps(_mm_madd_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)), lane_weights));
+        };
+        const auto high_half = [&](__m128i a, __m128i b, __m128i lane_weights) {
+            return _mm_cvtepi32_ps(_mm_madd_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)), lane_weights));
+        };
+
+        const __m128i top0 = upper(0);
+        const __m128i top1 = upper(1);
+        const __m128i top2 = upper(2);
+        const __m128i bottom0 = lower(0);
+        const __m128i bottom1 = lower(1);
+        const __m128i bottom2 = lower(2);
+
+        Float4 first;
+        Float4 second;
+        Float4 third;
+        split_thirds(low_half(top0, bottom0, starting_red), high_half(top0, bottom0, starting_blue), low_half(top1, bottom1, starting_green), first, second, third);
+        low = first + second + third;
+        split_thirds(high_half(top1, bottom1, starting_red), low_half(top2, bottom2, starting_blue), high_half(top2, bottom2, starting_green), first, second, third);
+        high = first + second + third;
+    }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+
+    friend Float4 abs(Float4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+    friend Float4 sqrt(Float4 a) { return { _mm_sqrt_ps(a.v) }; }
+    // Running total across the lanes: lane i holds a[0] + ... + a[i].
+    friend Float4 prefix_sum(Float4 a)
+    {
+        __m128 v = _mm_add_ps(a.v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a.v), 4)));
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+        return { v };
+    }
+
+    // Every lane set to the last one.
+    friend Float4 spread_last(Float4 a) { return { _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3)) }; }
+    friend float last_lane(Float4 a) { return _mm_cvtss_f32(spread_last(a).v); }
+    friend Float4 min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    friend Float4 max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+
+    // Bit i set when lane i of `a` >= lane i of `b`.
+    friend unsigned greater_equal_mask(Float4 a, Float4 b) { return static_cast<unsigned>(_mm_movemask_ps(_mm_cmpge_ps(a.v, b.v))); }
+#else
+    float v[WIDTH];
+
+    static Float4 load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    static Float4 broadcast(float x) { return { { x, x, x, x } }; }
+    void store(float* p) const { for(size_t i = 0; i < WIDTH; i++) { p[i] = v[i]; } }
+
+    static void load_rgb(const uint8_t* p, Float4& red, Float4& green, Float4& blue)
+    {
+        for(size_t i = 0; i < WIDTH; i++) {
+            red.v[i] = p[3 * i];
+            green.v[i] = p[3 * i + 1];
+            blue.v[i] = p[3 * i + 2];
+        }
+    }
+
+    static void load_weighted_bins(const uint8_t* top, const uint8_t* bottom, const int16_t (&weights)[3], Float4& low, Float4& high)
+    {
+        for(size_t j = 0; j < 2 * WIDTH; j++) {
+            int32_t sum = 0;
+            for(size_t i = 6 * j; i < 6 * j + 6; i++) {
+                sum += (top[i] + bottom[i]) * weights[i % 3];
+            }
+            (j < WIDTH ? low : high).v[j % WIDTH] = static_cast<float>(sum);
+        }
+    }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+    friend Float4 operator-(Float4 a, Float4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+    friend Float4 operator*(Float4 a, Float4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+    friend Float4 operator/(Float4 a, Float4 b) { return { { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } }; }
+
+    friend Float4 abs(Float4 a) { return { { std::abs(a.v[0]), std::abs(a.v[1]), std::abs(a.v[2]), std::abs(a.v[3]) } }; }
+    friend Float4 sqrt(Float4 a) { return { { std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]) } }; }
+    friend Float4 prefix_sum(Float4 a) { return { { a.v[0], a.v[0] + a.v[1], (a.v[1] + a.v[2]) + a.v[0], (a.v[2] + a.v[3]) + (a.v[0] + a.v[1]) } }; }
+    friend Float4 spread_last(Float4 a) { return broadcast(a.v[3]); }
+    friend float last_lane(Float4 a) { return a.v[3]; }
+    friend Float4 min(Float4 a, Float4 b) { return { { lane_min(a.v[0], b.v[0]), lane_min(a.v[1], b.v[1]), lane_min(a.v[2], b.v[2]), lane_min(a.v[3], b.v[3]) } }; }
+    friend Float4 max(Float4 a, Float4 b) { return { { lane_max(a.v[0], b.v[0]), lane_max(a.v[1], b.v[1]), lane_max(a.v[2], b.v[2]), lane_max(a.v[3], b.v[3]) } }; }
+
+    friend unsigned greater_equal_mask(Float4 a, Float4 b)
+    {
+        unsigned mask = 0;
+        for(size_t i = 0; i < WIDTH; i++) {
+            if(a.v[i] >= b.v[i]) {
+                mask |= 1U << i;
+            }
+        }
+        return mask;
+    }
+#endif
+
+    Float4& operator+=(Float4 other) { return *this = *this + other; }
+};
+
+// One float with the Float4 interface, so loop tails can share the vector code.
+struct Float1
+{
+    float v;
+
+    static Float1 load(const float* p) { return { *p }; }
+    static Float1 broadcast(float x) { return { x }; }
+    void store(float* p) const { *p = v; }
+
+    static void load_rgb(const uint8_t* p, Float1& red, Float1& green, Float1& blue)
+    {
+        red.v = p[0];
+        green.v = p[1];
+        blue.v = p[2];
+    }
+
+    friend Float1 operator+(Float1 a, Float1 b) { return { a.v + b.v }; }
+    friend Float1 operator-(Float1 a, Float1 b) { return { a.v - b.v }; }
+    friend Float1 operator*(Float1 a, Float1 b) { return { a.v * b.v }; }
+    friend Float1 operator/(Float1 a, Float1 b) { return { a.v / b.v }; }
+    friend Float1 abs(Float1 a) { return { std::abs(a.v) }; }
+    friend Float1 sqrt(Float1 a) { return { std::sqrt(a.v) }; }
+    friend Float1 prefix_sum(Float1 a) { return a; }
+    friend float last_lane(Float1 a) { return a.v; }
+    friend Float1 min(Float1 a, Float1 b) { return { lane_min(a.v, b.v) }; }
+    friend Float1 max(Float1 a, Float1 b) { return { lane_max(a.v, b.v) }; }
+    friend unsigned greater_equal_mask(Float1 a, Float1 b) { return a.v >= b.v ? 1U : 0U; }
+};
+
+// body(i, Float4 { }) over [begin, end) four elements at a time, then body(i, Float1 { }) for
+// what is left, so a kernel written once against the shared interface covers any length.
+template<typename Body>
+void for_each_lane(size_t begin, size_t end, Body&& body)
+{
+    size_t i = begin;
+    for(; i + Float4::WIDTH <= end; i += Float4::WIDTH) {
+        body(i, Float4 { });
+    }
+
+    for(; i < end; i++) {
+        body(i, Float1 { });
+    }
+}
@@ -0,0 +1,39 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "tone.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ToneCurve::ToneCurve(const Configuration& config, size_t levels)
+    : inverted(config.inverted), scale(static_cast<double>(levels - 1))
+{
+    if(config.gamma == 1 && config.contrast == 1 && config.brightness == 0) {
+        return;
+    }
+
+    const double exponent = 1 / std::max(config.gamma, 0.01);
+
+    table.resize(TABLE_STEPS + 1);
+    for(size_t i = 0; i <= TABLE_STEPS; i++) {
+        double value = std::pow(static_cast<double>(i) / TABLE_STEPS, exponent);
+        value = (value - 0.5) * config.contrast + 0.5 + config.brightness;
+        value = std::clamp(value, 0.0, 1.0);
+
+        table[i] = static_cast<float>(scale * (inverted ? value : 1 - value));
+    }
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Maps a cell's luminance to its position on the density ramp, [0, levels - 1]. Gamma,
+// contrast, brightness and -i are folded into one table when the config sets any of them, so
+// they cost a lookup per cell whatever their number; otherwise the plain inversion and scale
+// are computed directly.
+class ToneCurve
+{
+public:
+    ToneCurve(const Configuration& config, size_t levels);
+
+    double level(double luminance) const
+    {
+        if(table.empty()) {
+            return scale * (inverted ? luminance : 1 - luminance);
+        }
+
+        const double position = std::clamp(luminance, 0.0, 1.0) * static_cast<double>(TABLE_STEPS);
+        const size_t step = std::min(TABLE_STEPS - 1, static_cast<size_t>(position));
+        const double fraction = position - static_cast<double>(step);
+
+        return static_cast<double>(table[step]) + fraction * static_cast<double>(table[step + 1] - table[step]);
+    }
+
+private:
+    static constexpr size_t TABLE_STEPS = 1024;
+
+    bool inverted;
+    double scale;
+    std::vector<float> table;
+};
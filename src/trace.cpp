@@ -0,0 +1,147 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "trace.hpp"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Per thread; once full the oldest events are overwritten.
+static constexpr size_t RING_CAPACITY = 1 << 16;
+
+struct TraceEvent
+{
+    const char* name;
+    const char* arg_name;
+    int64_t arg;
+    int64_t timestamp_ns;
+    char phase;
+};
+
+struct ThreadBuffer
+{
+    std::array<TraceEvent, RING_CAPACITY> events;
+    uint64_t written = 0;
+    uint32_t tid = 0;
+    const char* name = nullptr;
+};
+
+std::atomic<bool> trace_enabled { false };
+
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+static std::chrono::steady_clock::time_point epoch;
+
+static ThreadBuffer& thread_buffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+
+    if(buffer == nullptr) {
+        // Buffers are owned by the registry so they survive worker threads exiting before the flush.
+        std::lock_guard lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        buffer = registry.back().get();
+        buffer->tid = static_cast<uint32_t>(registry.size());
+    }
+
+    return *buffer;
+}
+
+void trace_record(char phase, const char* name, const char* arg_name, int64_t arg)
+{
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+
+    ThreadBuffer& buffer = thread_buffer();
+    buffer.events[buffer.written % RING_CAPACITY] = { name, arg_name, arg, static_cast<int64_t>(now), phase };
+    buffer.written++;
+}
+
+void trace_thread_name(const char* name)
+{
+    if(trace_enabled.load(std::memory_order_relaxed)) {
+        thread_buffer().name = name;
+    }
+}
+
+static void write_trace(std::ostream& out)
+{
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ascii\"}}";
+    out << std::fixed << std::setprecision(3);
+
+    for(const auto& buffer : registry) {
+        if(buffer->name != nullptr) {
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+        }
+
+        const uint64_t first = buffer->written > RING_CAPACITY ? buffer->written - RING_CAPACITY : 0;
+        for(uint64_t i = first; i < buffer->written; i++) {
+            const TraceEvent& event = buffer->events[i % RING_CAPACITY];
+
+            out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase << "\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << static_cast<double>(event.timestamp_ns) / 1000.0;
+
+            if(event.arg_name != nullptr) {
+                out << ",\"args\":{\"" << event.arg_name << "\":" << event.arg << '}';
+            }
+
+            out << '}';
+        }
+    }
+
+    out << "\n]}\n";
+}
+
+TraceSession::TraceSession(std::string_view output_path)
+    : path(output_path)
+{
+    if(path.empty()) {
+        return;
+    }
+
+    epoch = std::chrono::steady_clock::now();
+    trace_enabled.store(true);
+    trace_thread_name("main");
+}
+
+TraceSession::~TraceSession()
+{
+    if(path.empty()) {
+        return;
+    }
+
+    trace_enabled.store(false);
+
+    std::lock_guard lock(registry_mutex);
+    std::ofstream file(path.data());
+    if(!file.is_open()) {
+        std::cerr << "Could not open " << path << '\n';
+        return;
+    }
+
+    write_trace(file);
+
+    file.close();
+    if(!file.good()) {
+        std::cerr << "Bad file: " << path << '\n';
+    }
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+// Chrome / Perfetto trace-event recorder. Every thread appends begin/end events to its own
+// fixed size ring buffer (no locking after the first event), and the buffers are serialized
+// to JSON when the owning TraceSession goes out of scope. While no session is active the
+// only cost of an event is one relaxed atomic load.
+
+extern std::atomic<bool> trace_enabled;
+
+// `name` and `arg_name` must be string literals (or otherwise outlive the session).
+void trace_record(char phase, const char* name, const char* arg_name, int64_t arg);
+
+// Name shown for the calling thread in the trace viewer.
+void trace_thread_name(const char* name);
+
+inline void trace_begin(const char* name, const char* arg_name = nullptr, int64_t arg = 0)
+{
+    if(trace_enabled.load(std::memory_order_relaxed)) {
+        trace_record('B', name, arg_name, arg);
+    }
+}
+
+inline void trace_end(const char* name)
+{
+    if(trace_enabled.load(std::memory_order_relaxed)) {
+        trace_record('E', name, nullptr, 0);
+    }
+}
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* event_name, const char* arg_name = nullptr, int64_t arg = 0)
+        : name(event_name)
+    {
+        trace_begin(name, arg_name, arg);
+    }
+
+    ~TraceScope() { trace_end(name); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+};
+
+// Enables tracing for its lifetime when given a non-empty path, and writes the collected
+// events there on destruction.
+class TraceSession
+{
+public:
+    explicit TraceSession(std::string_view output_path);
+    ~TraceSession();
+
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+
+private:
+    std::string_view path;
+};
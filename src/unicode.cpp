@@ -0,0 +1,115 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "unicode.hpp"
+
+#include <array>
+
+#include "simd.hpp"
+
+struct Utf8Glyph
+{
+    std::array<char, 3> bytes;
+    uint8_t length;
+
+    constexpr std::string_view view() const { return { bytes.data(), length }; }
+};
+
+static constexpr Utf8Glyph encode(uint32_t code_point)
+{
+    if(code_point < 0x80) {
+        return { { static_cast<char>(code_point), 0, 0 }, 1 };
+    }
+
+    // Everything used here lies in U+0800-U+FFFF.
+    return {
+        {
+            static_cast<char>(0xE0 | (code_point >> 12)),
+            static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)),
+            static_cast<char>(0x80 | (code_point & 0x3F)),
+        },
+        3,
+    };
+}
+
+// Unicode numbers braille dots down the left column (1-3), down the right (4-6), then the
+// bottom row (7, 8); indexed here by row major position in the 2x4 grid.
+static constexpr std::array<uint8_t, 8> BRAILLE_DOT_BITS { 0, 3, 1, 4, 2, 5, 6, 7 };
+
+static constexpr std::array<Utf8Glyph, 256> BRAILLE_GLYPHS = [] {
+    std::array<Utf8Glyph, 256> glyphs { };
+
+    glyphs[0] = encode(' ');
+    for(uint32_t mask = 1; mask < 256; mask++) {
+        uint32_t dots = 0;
+        for(size_t i = 0; i < BRAILLE_DOT_BITS.size(); i++) {
+            if((mask >> i) & 1) {
+                dots |= 1U << BRAILLE_DOT_BITS[i];
+            }
+        }
+
+        glyphs[mask] = encode(0x2800 + dots);
+    }
+
+    return glyphs;
+}();
+
+// Top left, top right, bottom left, bottom right.
+static constexpr std::array<Utf8Glyph, 16> QUADRANT_GLYPHS {
+    encode(' '),    encode(0x2598), encode(0x259D), encode(0x2580),
+    encode(0x2596), encode(0x258C), encode(0x259E), encode(0x259B),
+    encode(0x2597), encode(0x259A), encode(0x2590), encode(0x259C),
+    encode(0x2584), encode(0x2599), encode(0x259F), encode(0x2588),
+};
+
+size_t unicode_grid_cols(UnicodeMode mode)
+{
+    switch(mode) {
+        case UnicodeMode::BRAILLE:
+        case UnicodeMode::QUADRANTS: return 2;
+        default: return 0;
+    }
+}
+
+size_t unicode_grid_rows(UnicodeMode mode)
+{
+    switch(mode) {
+        case UnicodeMode::BRAILLE: return 4;
+        case UnicodeMode::QUADRANTS: return 2;
+        default: return 0;
+    }
+}
+
+uint8_t unicode_mask(UnicodeMode mode, const float* ink, float threshold)
+{
+    const Float4 limit = Float4::broadcast(threshold);
+    unsigned mask = greater_equal_mask(Float4::load(ink), limit);
+
+    if(mode == UnicodeMode::BRAILLE) {
+        mask |= greater_equal_mask(Float4::load(ink + Float4::WIDTH), limit) << Float4::WIDTH;
+    }
+
+    return static_cast<uint8_t>(mask);
+}
+
+std::string_view unicode_glyph(UnicodeMode mode, uint8_t mask)
+{
+    if(mode == UnicodeMode::BRAILLE) {
+        return BRAILLE_GLYPHS[mask].view();
+    }
+
+    return QUADRANT_GLYPHS[mask & 0xF].view();
+}
@@ -0,0 +1,38 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "conversion.hpp"
+
+// Braille (2x4 dots) and quadrant block (2x2) output. Each cell is sampled as a small grid,
+// every sample is thresholded into one bit of a row major mask, and the mask indexes a table
+// of UTF-8 encodings built at compile time, so emitting a cell is a single append.
+// UnicodeMode::HALF_BLOCKS is colour only and is drawn by HalfBlockWriter instead.
+
+size_t unicode_grid_cols(UnicodeMode mode);
+size_t unicode_grid_rows(UnicodeMode mode);
+
+// Bit (row * cols + col) is set for every sample with ink >= `threshold`. `ink` holds
+// unicode_grid_cols(mode) x unicode_grid_rows(mode) values, row major.
+uint8_t unicode_mask(UnicodeMode mode, const float* ink, float threshold);
+
+// UTF-8 encoding of the glyph lighting exactly the samples in `mask`; an empty mask is ' '.
+std::string_view unicode_glyph(UnicodeMode mode, uint8_t mask);
@@ -0,0 +1,151 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "upscale.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "luma.hpp"
+
+// Where each cell along one axis reads the sample grid: samples `lower` and `upper`, blended
+// by `weight` towards `upper`.
+struct AxisTaps
+{
+    std::vector<size_t> lower;
+    std::vector<size_t> upper;
+    std::vector<float> weight;
+};
+
+// Cells of a pixel or more have a sample of their own. Smaller ones sit inside the pixels:
+// the cell's centre, in pixel coordinates, picks the pixel under it or the two pixel centres
+// either side of it.
+static AxisTaps axis_taps(UpscaleFilter filter, size_t cells, size_t extent, double cell_size)
+{
+    AxisTaps taps;
+    taps.lower.resize(cells);
+    taps.upper.resize(cells);
+    taps.weight.resize(cells, 0);
+
+    for(size_t i = 0; i < cells; i++) {
+        const double centre = (static_cast<double>(i) + 0.5) * cell_size;
+
+        if(cell_size >= 1) {
+            taps.lower[i] = i;
+        } else if(filter == UpscaleFilter::NEAREST) {
+            taps.lower[i] = std::min(extent - 1, static_cast<size_t>(centre));
+        } else {
+            const double position = std::clamp(centre - 0.5, 0.0, static_cast<double>(extent - 1));
+            taps.lower[i] = static_cast<size_t>(position);
+            taps.weight[i] = static_cast<float>(position - std::floor(position));
+        }
+
+        taps.upper[i] = taps.weight[i] > 0 ? taps.lower[i] + 1 : taps.lower[i];
+    }
+
+    return taps;
+}
+
+UpscaledCells::UpscaledCells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& column_spans, const CellSpans& row_spans, double quad_width, double quad_height)
+    : columns(column_spans.size())
+{
+    const bool reduce_x = quad_width >= 1;
+    const bool reduce_y = quad_height >= 1;
+    const size_t sample_cols = reduce_x ? column_spans.size() : img_width;
+    const size_t sample_rows = reduce_y ? row_spans.size() : img_height;
+
+    // Channels are kept as sRGB levels, or 16 bit linear light with -l.
+    std::vector<float> sample_luma(sample_cols * sample_rows);
+    std::vector<float> sample_channels(sample_cols * sample_rows * 3);
+
+    for(size_t sy = 0; sy < sample_rows; sy++) {
+        const size_t y_begin = reduce_y ? row_spans.begin[sy] : sy;
+        const size_t y_end = reduce_y ? row_spans.end[sy] : sy + 1;
+
+        for(size_t sx = 0; sx < sample_cols; sx++) {
+            const size_t x_begin = reduce_x ? column_spans.begin[sx] : sx;
+            const size_t x_end = reduce_x ? column_spans.end[sx] : sx + 1;
+
+            double luma_sum = 0;
+            uint64_t sums[3] { };
+
+            for(size_t y = y_begin; y < y_end; y++) {
+                const Color* row = pixels.get() + y * img_width;
+                for(size_t x = x_begin; x < x_end; x++) {
+                    if(config.linear) {
+                        sums[0] += SRGB_TO_LINEAR[row[x].red];
+                        sums[1] += SRGB_TO_LINEAR[row[x].green];
+                        sums[2] += SRGB_TO_LINEAR[row[x].blue];
+                    } else {
+                        luma_sum += configured_luma(config, row[x]);
+                        sums[0] += row[x].red;
+                        sums[1] += row[x].green;
+                        sums[2] += row[x].blue;
+                    }
+                }
+            }
+
+            const size_t sample = sy * sample_cols + sx;
+            const auto count = static_cast<double>((y_end - y_begin) * (x_end - x_begin));
+            sample_luma[sample] = static_cast<float>(luma_sum / count);
+            for(size_t c = 0; c < 3; c++) {
+                sample_channels[3 * sample + c] = static_cast<float>(static_cast<double>(sums[c]) / count);
+            }
+        }
+    }
+
+    const AxisTaps x_taps = axis_taps(config.upscale, column_spans.size(), img_width, quad_width);
+    const AxisTaps y_taps = axis_taps(config.upscale, row_spans.size(), img_height, quad_height);
+
+    cell_luminance.resize(column_spans.size() * row_spans.size());
+    cell_colors.resize(column_spans.size() * row_spans.size());
+
+    for(size_t row = 0; row < row_spans.size(); row++) {
+        const size_t top = y_taps.lower[row] * sample_cols;
+        const size_t bottom = y_taps.upper[row] * sample_cols;
+        const float fy = y_taps.weight[row];
+
+        for(size_t col = 0; col < columns; col++) {
+            const size_t left = x_taps.lower[col];
+            const size_t right = x_taps.upper[col];
+            const float fx = x_taps.weight[col];
+
+            const auto blend = [&](const float* values, size_t stride, size_t offset) {
+                const float upper = values[(top + left) * stride + offset] * (1 - fx) + values[(top + right) * stride + offset] * fx;
+                const float lower = values[(bottom + left) * stride + offset] * (1 - fx) + values[(bottom + right) * stride + offset] * fx;
+                return upper * (1 - fy) + lower * fy;
+            };
+
+            Color& color = cell_colors[row * columns + col];
+            if(config.linear) {
+                const uint64_t linear[3] {
+                    static_cast<uint64_t>(std::lround(blend(sample_channels.data(), 3, 0))),
+                    static_cast<uint64_t>(std::lround(blend(sample_channels.data(), 3, 1))),
+                    static_cast<uint64_t>(std::lround(blend(sample_channels.data(), 3, 2))),
+                };
+                color = linear_mean(linear, 1);
+                cell_luminance[row * columns + col] = configured_luma(config, color);
+            } else {
+                color = {
+                    static_cast<uint8_t>(std::lround(blend(sample_channels.data(), 3, 0))),
+                    static_cast<uint8_t>(std::lround(blend(sample_channels.data(), 3, 1))),
+                    static_cast<uint8_t>(std::lround(blend(sample_channels.data(), 3, 2))),
+                };
+                cell_luminance[row * columns + col] = static_cast<double>(blend(sample_luma.data(), 1, 0));
+            }
+        }
+    }
+}
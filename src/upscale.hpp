@@ -0,0 +1,50 @@
+/*
+    Copyright 2022 Eduardo Ibarra
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "conversion.hpp"
+
+// Whether cells are narrower or shorter than a pixel, so some of them hold no whole pixel.
+constexpr bool upscaling(double quad_width, double quad_height)
+{
+    return quad_width < 1 || quad_height < 1;
+}
+
+// Mean luma and colour of every cell when cells are smaller than a pixel along either axis.
+// The image is read once into a grid of samples: along an axis with cells of a pixel or more
+// each sample is the mean of one cell's span, as in the box path, and along an upscaled axis
+// each sample is one pixel, so every pixel's luma is computed once however many cells show
+// it. Cells then take the sample under their centre (`config.upscale` NEAREST) or blend the
+// four around it (BILINEAR).
+class UpscaledCells
+{
+public:
+    UpscaledCells(const Configuration& config, const std::unique_ptr<Color[]>& pixels, size_t img_width, size_t img_height, const CellSpans& columns, const CellSpans& rows, double quad_width, double quad_height);
+
+    double luminance(size_t row, size_t col) const { return cell_luminance[row * columns + col]; }
+    Color color(size_t row, size_t col) const { return cell_colors[row * columns + col]; }
+
+private:
+    size_t columns;
+
+    std::vector<double> cell_luminance;
+    std::vector<Color> cell_colors;
+};